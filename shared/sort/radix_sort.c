@@ -0,0 +1,86 @@
+/*
+ * Copyright (c) 2012-2019 Israel Jacquez
+ * See LICENSE for details.
+ *
+ * Israel Jacquez <mrkotfw@gmail.com>
+ */
+
+#include <yaul.h>
+
+#include <assert.h>
+#include <string.h>
+
+#include "radix_sort.h"
+
+#define RADIX_BITS      8
+#define RADIX_COUNT     (1 << RADIX_BITS)
+#define RADIX_MASK      (RADIX_COUNT - 1)
+
+/* Both passes ping-pong between the caller's pairs and this buffer, so the
+ * result ends up back in the caller's buffer */
+static radix_sort_pair_t _scratch[RADIX_SORT_PAIR_COUNT_MAX];
+
+static uint16_t _histograms[2][RADIX_COUNT];
+
+static void _pass(const radix_sort_pair_t *, radix_sort_pair_t *, uint32_t,
+    uint16_t *, uint32_t);
+
+void
+radix_sort(radix_sort_pair_t *pairs, uint32_t count)
+{
+        assert(count <= RADIX_SORT_PAIR_COUNT_MAX);
+
+        if (count <= 1) {
+                return;
+        }
+
+        (void)memset(_histograms, 0x00, sizeof(_histograms));
+
+        /* Build both histograms in a single read of the pairs */
+        for (uint32_t i = 0; i < count; i++) {
+                const uint16_t depth = pairs[i].depth;
+
+                _histograms[0][depth & RADIX_MASK]++;
+                _histograms[1][depth >> RADIX_BITS]++;
+        }
+
+        /* When every key shares the same high byte (the common case for a
+         * single object), the second pass would be a plain copy */
+        if (_histograms[1][pairs[0].depth >> RADIX_BITS] == count) {
+                if (_histograms[0][pairs[0].depth & RADIX_MASK] == count) {
+                        return;
+                }
+
+                _pass(pairs, _scratch, count, _histograms[0], 0);
+
+                (void)memcpy(pairs, _scratch, count * sizeof(radix_sort_pair_t));
+
+                return;
+        }
+
+        _pass(pairs, _scratch, count, _histograms[0], 0);
+        _pass(_scratch, pairs, count, _histograms[1], RADIX_BITS);
+}
+
+static void
+_pass(const radix_sort_pair_t *in, radix_sort_pair_t *out, uint32_t count,
+    uint16_t *histogram, uint32_t shift)
+{
+        uint16_t offset;
+        offset = 0;
+
+        /* Turn the histogram into starting offsets */
+        for (uint32_t i = 0; i < RADIX_COUNT; i++) {
+                const uint16_t bucket_count = histogram[i];
+
+                histogram[i] = offset;
+                offset += bucket_count;
+        }
+
+        for (uint32_t i = 0; i < count; i++) {
+                const uint32_t digit = (in[i].depth >> shift) & RADIX_MASK;
+
+                out[histogram[digit]] = in[i];
+                histogram[digit]++;
+        }
+}
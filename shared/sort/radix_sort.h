@@ -0,0 +1,26 @@
+#ifndef _SHARED_SORT_RADIX_SORT_H_
+#define _SHARED_SORT_RADIX_SORT_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* Maximum number of pairs that can be sorted in one call. This sizes the
+ * scratch buffer, and can be overridden from the example's Makefile */
+#ifndef RADIX_SORT_PAIR_COUNT_MAX
+#define RADIX_SORT_PAIR_COUNT_MAX 2048
+#endif /* !RADIX_SORT_PAIR_COUNT_MAX */
+
+typedef struct radix_sort_pair radix_sort_pair_t;
+
+/* The depth is the sort key, and the index refers back to whatever the caller
+ * is sorting (a face, a primitive, etc.) */
+struct radix_sort_pair {
+        uint16_t depth;
+        uint16_t index;
+} __attribute__ ((aligned (4)));
+
+/* Stable sort of the pairs in ascending order of depth. Callers that want to
+ * draw far-to-near should invert their depth when building the key */
+void radix_sort(radix_sort_pair_t *, uint32_t);
+
+#endif /* _SHARED_SORT_RADIX_SORT_H_ */
@@ -20,8 +20,42 @@ struct balls_handle {
 
         balls_load_callback load_callback;
         int8_t load_count;
+
+        uint16_t patch_count;
+};
+
+struct balls_dual_work {
+        balls_handle_t handle;
+        vdp1_cmdt_t *cmdts;
+        uint16_t start;
+        uint16_t end;
+        bool done;
 };
 
+struct balls_cmdt_patch {
+        int16_t xa;
+        int16_t ya;
+} __aligned(4);
+
+static volatile struct balls_dual_work _dual_work __section(".uncached");
+
+/* One indirect transfer per ball, each writing CMDXA and CMDYA */
+static scu_dma_xfer_t _patch_xfer_table[BALL_MAX_COUNT] __aligned(BALL_MAX_COUNT * 16);
+static struct balls_cmdt_patch _patches[BALL_MAX_COUNT];
+
+static void _position_update(balls_handle_t handle, const uint16_t start,
+    const uint16_t end);
+static void _position_clamp(balls_handle_t handle, const uint16_t start,
+    const uint16_t end);
+static void _cmdt_list_update(balls_handle_t handle, vdp1_cmdt_t *cmdts,
+    const uint16_t start, const uint16_t end);
+static void _fused_update(balls_handle_t handle, vdp1_cmdt_t *cmdts,
+    const uint16_t start, const uint16_t end);
+static void _fused_patch_update(balls_handle_t handle, const uint16_t start,
+    const uint16_t end);
+
+static void _dual_slave_entry(void);
+
 static void _dma_upload(balls_handle_t handle, const void *dst,
     const void *src, size_t len);
 static void _dma_upload_handler(const dma_queue_transfer_t *transfer);
@@ -34,8 +68,26 @@ balls_init(const struct balls_config *config)
 
         (void)memcpy(&handle->config, config, sizeof(struct balls_config));
 
-        (void)memset(&handle->config.balls[0], 0x00,
-            handle->config.count * sizeof(struct ball));
+        handle->patch_count = 0;
+
+        const uint16_t count = handle->config.count;
+
+        switch (handle->config.layout) {
+        case BALLS_LAYOUT_AOS:
+                (void)memset(&handle->config.balls[0], 0x00,
+                    count * sizeof(struct ball));
+                break;
+        case BALLS_LAYOUT_SOA:
+                (void)memset(&handle->config.pos_x[0], 0x00,
+                    count * sizeof(q0_12_4_t));
+                (void)memset(&handle->config.pos_y[0], 0x00,
+                    count * sizeof(q0_12_4_t));
+                (void)memset(&handle->config.speed[0], 0x00,
+                    count * sizeof(q0_12_4_t));
+                break;
+        default:
+                assert(false);
+        }
 
         return handle;
 }
@@ -70,46 +122,17 @@ balls_sprite_load(balls_handle_t handle, balls_load_callback callback)
 void
 balls_position_update(balls_handle_t handle, const uint16_t count)
 {
-        for (uint16_t i = 0; i < count; i++) {
-                struct ball *ball = &handle->config.balls[i];
+        assert(handle->config.layout == BALLS_LAYOUT_AOS);
 
-                /* Map bit 0 as direction:
-                 *   dir_?_bit: 0 -> ((0-1)^0xFF)=0x00 -> positive
-                 *   dir_?_bit: 1 -> ((1-1)^0xFF)=0xFF -> negative */
-                const int8_t dir_x_bit = ball->pos_x & 0x0001;
-                const uint8_t d_x = (dir_x_bit - 1) ^ 0xFF;
-                const q0_12_4_t fixed_dir_x = (q0_12_4_t)((int8_t)d_x ^ ball->speed);
-
-                const int8_t dir_y_bit = ball->pos_y & 0x0001;
-                const uint8_t d_y = (dir_y_bit - 1) ^ 0xFF;
-                const q0_12_4_t fixed_dir_y = (q0_12_4_t)((int8_t)d_y ^ ball->speed);
-
-                ball->pos_x = (ball->pos_x + fixed_dir_x) | dir_x_bit;
-                ball->pos_y = (ball->pos_y + fixed_dir_y) | dir_y_bit;
-        }
+        _position_update(handle, 0, count);
 }
 
 void
 balls_position_clamp(balls_handle_t handle, const uint16_t count)
 {
-        const q0_12_4_t left_clamp = -SCREEN_HWIDTH_Q;
-        const q0_12_4_t right_clamp = SCREEN_HWIDTH_Q;
-
-        for (uint16_t i = 0; i < count; i++) {
-                struct ball *ball = &handle->config.balls[i];
-
-                if (ball->pos_x <= left_clamp) {
-                        ball->pos_x = (left_clamp + ball->speed) & ~0x0001;
-                } else if (ball->pos_x > right_clamp) {
-                        ball->pos_x = (right_clamp - ball->speed) | 0x0001;
-                }
+        assert(handle->config.layout == BALLS_LAYOUT_AOS);
 
-                if (ball->pos_y < (-SCREEN_HHEIGHT_Q)) {
-                        ball->pos_y = ((-SCREEN_HHEIGHT_Q) + ball->speed) & ~0x0001;
-                } else if (ball->pos_y > SCREEN_HHEIGHT_Q) {
-                        ball->pos_y = (SCREEN_HHEIGHT_Q - ball->speed) | 0x0001;
-                }
-        }
+        _position_clamp(handle, 0, count);
 }
 
 void
@@ -154,19 +177,313 @@ balls_cmdt_list_init(balls_handle_t handle, vdp1_cmdt_t *cmdts, const uint16_t c
 void
 balls_cmdt_list_update(balls_handle_t handle, vdp1_cmdt_t *cmdts, const uint16_t count)
 {
+        assert(handle->config.layout == BALLS_LAYOUT_AOS);
+
+        _cmdt_list_update(handle, cmdts, 0, count);
+}
+
+void
+balls_fused_update(balls_handle_t handle, vdp1_cmdt_t *cmdts,
+    const uint16_t count)
+{
+        _fused_update(handle, cmdts, 0, count);
+}
+
+void
+balls_cmdt_patch_init(balls_handle_t handle, vdp1_cmdt_t *vram_cmdts)
+{
+        const uint16_t count = handle->config.count;
+
+        assert(count <= BALL_MAX_COUNT);
+
         for (uint16_t i = 0; i < count; i++) {
+                scu_dma_xfer_t * const xfer = &_patch_xfer_table[i];
+
+                xfer->len = sizeof(struct balls_cmdt_patch);
+                xfer->dst = (uint32_t)&vram_cmdts[i].cmd_xa;
+                xfer->src = CPU_CACHE_THROUGH | (uint32_t)&_patches[i];
+        }
+
+        handle->patch_count = 0;
+}
+
+void
+balls_cmdt_patch_update(balls_handle_t handle, const uint16_t count)
+{
+        _fused_patch_update(handle, 0, count);
+}
+
+void
+balls_cmdt_patch_put(balls_handle_t handle, const uint16_t count,
+    const uint8_t tag)
+{
+        if (count == 0) {
+                return;
+        }
+
+        /* Move the end of the indirect table */
+        if (handle->patch_count != count) {
+                if (handle->patch_count > 0) {
+                        _patch_xfer_table[handle->patch_count - 1].src &=
+                            ~SCU_DMA_INDIRECT_TABLE_END;
+                }
+
+                _patch_xfer_table[count - 1].src |= SCU_DMA_INDIRECT_TABLE_END;
+
+                handle->patch_count = count;
+        }
+
+        const struct scu_dma_level_cfg scu_dma_level_cfg = {
+                .xfer.indirect = &_patch_xfer_table[0],
+                .mode = SCU_DMA_MODE_INDIRECT,
+                .stride = SCU_DMA_STRIDE_2_BYTES,
+                .update = SCU_DMA_UPDATE_NONE
+        };
+
+        struct scu_dma_handle dma_handle;
+
+        scu_dma_config_buffer(&dma_handle, &scu_dma_level_cfg);
+
+        int8_t ret;
+        ret = dma_queue_enqueue(&dma_handle, tag, NULL, NULL);
+        assert(ret == 0);
+}
+
+void
+balls_dual_init(void)
+{
+        _dual_work.handle = NULL;
+        _dual_work.cmdts = NULL;
+        _dual_work.start = 0;
+        _dual_work.end = 0;
+        _dual_work.done = true;
+
+        cpu_dual_slave_set(_dual_slave_entry);
+}
+
+void
+balls_dual_update(balls_handle_t handle, vdp1_cmdt_t *cmdts,
+    const uint16_t count)
+{
+        /* The slave takes the upper half, the master the lower half. The
+         * master also owns the rest of the frame, so on odd counts the
+         * extra ball goes to the slave */
+        const uint16_t split = count >> 1;
+
+        _dual_work.handle = handle;
+        _dual_work.cmdts = cmdts;
+        _dual_work.start = split;
+        _dual_work.end = count;
+        _dual_work.done = false;
+
+        cpu_dual_slave_notify();
+
+        _fused_update(handle, cmdts, 0, split);
+
+        while (!_dual_work.done) {
+        }
+
+        /* The split point moves with the ball count, so make sure the master
+         * never reads back stale lines of balls last updated by the slave */
+        cpu_cache_purge();
+}
+
+static inline __always_inline void
+_ball_step(q0_12_4_t *pos_x, q0_12_4_t *pos_y, const q0_12_4_t speed)
+{
+        const q0_12_4_t left_clamp = -SCREEN_HWIDTH_Q;
+        const q0_12_4_t right_clamp = SCREEN_HWIDTH_Q;
+
+        q0_12_4_t x = *pos_x;
+        q0_12_4_t y = *pos_y;
+
+        /* Same as _position_update() */
+        const int8_t dir_x_bit = x & 0x0001;
+        const uint8_t d_x = (dir_x_bit - 1) ^ 0xFF;
+        const q0_12_4_t fixed_dir_x = (q0_12_4_t)((int8_t)d_x ^ speed);
+
+        const int8_t dir_y_bit = y & 0x0001;
+        const uint8_t d_y = (dir_y_bit - 1) ^ 0xFF;
+        const q0_12_4_t fixed_dir_y = (q0_12_4_t)((int8_t)d_y ^ speed);
+
+        x = (x + fixed_dir_x) | dir_x_bit;
+        y = (y + fixed_dir_y) | dir_y_bit;
+
+        /* Same as _position_clamp() */
+        if (x <= left_clamp) {
+                x = (left_clamp + speed) & ~0x0001;
+        } else if (x > right_clamp) {
+                x = (right_clamp - speed) | 0x0001;
+        }
+
+        if (y < (-SCREEN_HHEIGHT_Q)) {
+                y = ((-SCREEN_HHEIGHT_Q) + speed) & ~0x0001;
+        } else if (y > SCREEN_HHEIGHT_Q) {
+                y = (SCREEN_HHEIGHT_Q - speed) | 0x0001;
+        }
+
+        *pos_x = x;
+        *pos_y = y;
+}
+
+static inline __always_inline void
+_ball_cmdt_set(vdp1_cmdt_t *cmdt, const q0_12_4_t pos_x, const q0_12_4_t pos_y)
+{
+        vdp1_cmdt_normal_sprite_set(cmdt);
+
+        cmdt->cmd_xa = Q0_12_4_INT(pos_x) - BALL_HWIDTH - 1;
+        cmdt->cmd_ya = Q0_12_4_INT(pos_y) - BALL_HHEIGHT - 1;
+}
+
+static inline __always_inline void
+_ball_patch_set(struct balls_cmdt_patch *patch, const q0_12_4_t pos_x,
+    const q0_12_4_t pos_y)
+{
+        patch->xa = Q0_12_4_INT(pos_x) - BALL_HWIDTH - 1;
+        patch->ya = Q0_12_4_INT(pos_y) - BALL_HHEIGHT - 1;
+}
+
+static void
+_position_update(balls_handle_t handle, const uint16_t start,
+    const uint16_t end)
+{
+        for (uint16_t i = start; i < end; i++) {
                 struct ball *ball = &handle->config.balls[i];
 
-                vdp1_cmdt_t *cmdt;
-                cmdt = &cmdts[i];
+                /* Map bit 0 as direction:
+                 *   dir_?_bit: 0 -> ((0-1)^0xFF)=0x00 -> positive
+                 *   dir_?_bit: 1 -> ((1-1)^0xFF)=0xFF -> negative */
+                const int8_t dir_x_bit = ball->pos_x & 0x0001;
+                const uint8_t d_x = (dir_x_bit - 1) ^ 0xFF;
+                const q0_12_4_t fixed_dir_x = (q0_12_4_t)((int8_t)d_x ^ ball->speed);
 
-                vdp1_cmdt_normal_sprite_set(cmdt);
+                const int8_t dir_y_bit = ball->pos_y & 0x0001;
+                const uint8_t d_y = (dir_y_bit - 1) ^ 0xFF;
+                const q0_12_4_t fixed_dir_y = (q0_12_4_t)((int8_t)d_y ^ ball->speed);
 
-                cmdt->cmd_xa = Q0_12_4_INT(ball->pos_x) - BALL_HWIDTH - 1;
-                cmdt->cmd_ya = Q0_12_4_INT(ball->pos_y) - BALL_HHEIGHT - 1;
+                ball->pos_x = (ball->pos_x + fixed_dir_x) | dir_x_bit;
+                ball->pos_y = (ball->pos_y + fixed_dir_y) | dir_y_bit;
         }
 }
 
+static void
+_position_clamp(balls_handle_t handle, const uint16_t start,
+    const uint16_t end)
+{
+        const q0_12_4_t left_clamp = -SCREEN_HWIDTH_Q;
+        const q0_12_4_t right_clamp = SCREEN_HWIDTH_Q;
+
+        for (uint16_t i = start; i < end; i++) {
+                struct ball *ball = &handle->config.balls[i];
+
+                if (ball->pos_x <= left_clamp) {
+                        ball->pos_x = (left_clamp + ball->speed) & ~0x0001;
+                } else if (ball->pos_x > right_clamp) {
+                        ball->pos_x = (right_clamp - ball->speed) | 0x0001;
+                }
+
+                if (ball->pos_y < (-SCREEN_HHEIGHT_Q)) {
+                        ball->pos_y = ((-SCREEN_HHEIGHT_Q) + ball->speed) & ~0x0001;
+                } else if (ball->pos_y > SCREEN_HHEIGHT_Q) {
+                        ball->pos_y = (SCREEN_HHEIGHT_Q - ball->speed) | 0x0001;
+                }
+        }
+}
+
+static void
+_cmdt_list_update(balls_handle_t handle, vdp1_cmdt_t *cmdts,
+    const uint16_t start, const uint16_t end)
+{
+        for (uint16_t i = start; i < end; i++) {
+                struct ball *ball = &handle->config.balls[i];
+
+                _ball_cmdt_set(&cmdts[i], ball->pos_x, ball->pos_y);
+        }
+}
+
+/* Exactly one of cmdts or patches is expected to be non-NULL. Both are
+ * constant at each call site, so the check is folded away */
+static inline __always_inline void
+_fused_update_aos(balls_handle_t handle, vdp1_cmdt_t *cmdts,
+    struct balls_cmdt_patch *patches, const uint16_t start, const uint16_t end)
+{
+        struct ball *ball = &handle->config.balls[start];
+
+        for (uint16_t i = start; i < end; i++, ball++) {
+                _ball_step(&ball->pos_x, &ball->pos_y, ball->speed);
+
+                if (patches != NULL) {
+                        _ball_patch_set(&patches[i], ball->pos_x, ball->pos_y);
+                } else {
+                        _ball_cmdt_set(&cmdts[i], ball->pos_x, ball->pos_y);
+                }
+        }
+}
+
+static inline __always_inline void
+_fused_update_soa(balls_handle_t handle, vdp1_cmdt_t *cmdts,
+    struct balls_cmdt_patch *patches, const uint16_t start, const uint16_t end)
+{
+        q0_12_4_t * const pos_x = handle->config.pos_x;
+        q0_12_4_t * const pos_y = handle->config.pos_y;
+        const q0_12_4_t * const speed = handle->config.speed;
+
+        for (uint16_t i = start; i < end; i++) {
+                _ball_step(&pos_x[i], &pos_y[i], speed[i]);
+
+                if (patches != NULL) {
+                        _ball_patch_set(&patches[i], pos_x[i], pos_y[i]);
+                } else {
+                        _ball_cmdt_set(&cmdts[i], pos_x[i], pos_y[i]);
+                }
+        }
+}
+
+static void
+_fused_update(balls_handle_t handle, vdp1_cmdt_t *cmdts,
+    const uint16_t start, const uint16_t end)
+{
+        switch (handle->config.layout) {
+        case BALLS_LAYOUT_AOS:
+                _fused_update_aos(handle, cmdts, NULL, start, end);
+                break;
+        case BALLS_LAYOUT_SOA:
+                _fused_update_soa(handle, cmdts, NULL, start, end);
+                break;
+        }
+}
+
+static void
+_fused_patch_update(balls_handle_t handle, const uint16_t start,
+    const uint16_t end)
+{
+        switch (handle->config.layout) {
+        case BALLS_LAYOUT_AOS:
+                _fused_update_aos(handle, NULL, _patches, start, end);
+                break;
+        case BALLS_LAYOUT_SOA:
+                _fused_update_soa(handle, NULL, _patches, start, end);
+                break;
+        }
+}
+
+static void
+_dual_slave_entry(void)
+{
+        balls_handle_t handle = _dual_work.handle;
+        vdp1_cmdt_t *cmdts = _dual_work.cmdts;
+
+        const uint16_t start = _dual_work.start;
+        const uint16_t end = _dual_work.end;
+
+        /* The slave may still hold lines of balls last updated by the master */
+        cpu_cache_purge();
+
+        _fused_update(handle, cmdts, start, end);
+
+        _dual_work.done = true;
+}
+
 static void
 _dma_upload(balls_handle_t handle, const void *dst, const void *src, size_t len)
 {
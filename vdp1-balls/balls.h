@@ -18,8 +18,20 @@ struct ball {
         q0_12_4_t pos_y; /* 2-bytes */
 };
 
+#define BALLS_LAYOUT_AOS        0 /* Array of structures */
+#define BALLS_LAYOUT_SOA        1 /* Structure of arrays */
+
 struct balls_config {
+        uint8_t layout;
+
+        /* BALLS_LAYOUT_AOS */
         struct ball *balls;
+
+        /* BALLS_LAYOUT_SOA. Each array should be aligned to a cache line */
+        q0_12_4_t *pos_x;
+        q0_12_4_t *pos_y;
+        q0_12_4_t *speed;
+
         uint16_t count;
 
         void *sprite_tex_base;
@@ -36,12 +48,38 @@ typedef void (*balls_load_callback)(balls_handle_t handle);
 
 balls_handle_t balls_init(const struct balls_config *config);
 void balls_sprite_load(balls_handle_t handle, balls_load_callback callback);
+
+/* Only valid for BALLS_LAYOUT_AOS */
 void balls_position_update(balls_handle_t handle, const uint16_t count);
 void balls_position_clamp(balls_handle_t handle, const uint16_t count);
 
 void balls_cmdt_list_init(balls_handle_t handle, vdp1_cmdt_t *cmdts,
     const uint16_t count);
+
+/* Only valid for BALLS_LAYOUT_AOS */
 void balls_cmdt_list_update(balls_handle_t handle, vdp1_cmdt_t *cmdts,
     const uint16_t count);
 
+/* Update, clamp and write the command tables in a single pass. Valid for
+ * both layouts */
+void balls_fused_update(balls_handle_t handle, vdp1_cmdt_t *cmdts,
+    const uint16_t count);
+
+/* Write-only vertex patch stream. Instead of uploading whole command tables,
+ * only CMDXA and CMDYA of each ball are transferred, through a SCU-DMA
+ * indirect table. The command tables must already be in VDP1 VRAM, starting
+ * at vram_cmdts, and the ball count must not change between full uploads.
+ * VDP1 reads the command tables while it draws, so only put the patch once
+ * it's done, e.g. from the vdp1_sync_cmdt_list_put() callback */
+void balls_cmdt_patch_init(balls_handle_t handle, vdp1_cmdt_t *vram_cmdts);
+void balls_cmdt_patch_update(balls_handle_t handle, const uint16_t count);
+void balls_cmdt_patch_put(balls_handle_t handle, const uint16_t count,
+    const uint8_t tag);
+
+/* Split the fused update across both CPUs. Expects
+ * cpu_dual_init(CPU_DUAL_ENTRY_ICI) to have been called */
+void balls_dual_init(void);
+void balls_dual_update(balls_handle_t handle, vdp1_cmdt_t *cmdts,
+    const uint16_t count);
+
 #endif /* !BALL_H */
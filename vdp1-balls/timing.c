@@ -0,0 +1,176 @@
+#include <yaul.h>
+
+#include <stdio.h>
+
+#include "vdp1-balls.h"
+
+#include "timing.h"
+
+/* The example runs in 352 mode */
+#define TIMING_COUNT_1MS        CPU_FRT_NTSC_352_32_COUNT_1MS
+
+struct timing_row {
+        uint32_t samples;
+        uint32_t ticks[TIMING_STAGE_COUNT];
+};
+
+static const char *_stage_names[TIMING_STAGE_COUNT] = {
+        "update",
+        "clamp",
+        "emit",
+        "put",
+        "sync"
+};
+
+static uint16_t _mark;
+static uint16_t _frame_ticks[TIMING_STAGE_COUNT];
+
+static uint16_t _window[TIMING_WINDOW_COUNT][TIMING_STAGE_COUNT];
+static uint32_t _window_sums[TIMING_STAGE_COUNT];
+static uint32_t _window_index;
+
+static struct timing_row _rows[BALL_MAX_COUNT + 1];
+
+static uint32_t _ticks_us_convert(uint32_t ticks);
+
+void
+timing_init(void)
+{
+        timing_reset();
+}
+
+void
+timing_reset(void)
+{
+        (void)memset(_frame_ticks, 0x00, sizeof(_frame_ticks));
+        (void)memset(_window, 0x00, sizeof(_window));
+        (void)memset(_window_sums, 0x00, sizeof(_window_sums));
+        (void)memset(_rows, 0x00, sizeof(_rows));
+
+        _window_index = 0;
+
+        _mark = cpu_frt_count_get();
+}
+
+void
+timing_stage_begin(void)
+{
+        _mark = cpu_frt_count_get();
+}
+
+void
+timing_stage_end(uint8_t stage)
+{
+        const uint16_t now = cpu_frt_count_get();
+
+        /* Unsigned 16-bit arithmetic takes care of a single wrap around */
+        _frame_ticks[stage] += (uint16_t)(now - _mark);
+
+        _mark = now;
+}
+
+void
+timing_stage_name_set(uint8_t stage, const char *name)
+{
+        assert(stage < TIMING_STAGE_COUNT);
+
+        _stage_names[stage] = name;
+}
+
+void
+timing_frame_end(uint16_t ball_count)
+{
+        assert(ball_count <= BALL_MAX_COUNT);
+
+        struct timing_row * const row = &_rows[ball_count];
+        uint16_t * const window = _window[_window_index];
+
+        row->samples++;
+
+        for (uint32_t stage = 0; stage < TIMING_STAGE_COUNT; stage++) {
+                const uint16_t ticks = _frame_ticks[stage];
+
+                row->ticks[stage] += ticks;
+
+                _window_sums[stage] -= window[stage];
+                _window_sums[stage] += ticks;
+                window[stage] = ticks;
+
+                _frame_ticks[stage] = 0;
+        }
+
+        _window_index = (_window_index + 1) & (TIMING_WINDOW_COUNT - 1);
+}
+
+void
+timing_hud_print(void)
+{
+        uint32_t total_us;
+        total_us = 0;
+
+        for (uint32_t stage = 0; stage < TIMING_STAGE_COUNT; stage++) {
+                const uint32_t us =
+                    _ticks_us_convert(_window_sums[stage] / TIMING_WINDOW_COUNT);
+
+                total_us += us;
+
+                dbgio_printf("%-7s %3lu.%03lums\n",
+                    _stage_names[stage], us / 1000, us % 1000);
+        }
+
+        dbgio_printf("%-7s %3lu.%03lums\n", "total", total_us / 1000,
+            total_us % 1000);
+}
+
+void
+timing_csv_dump(const char *label __unused)
+{
+#ifdef TIMING_USB_CART
+        char line[128];
+        int len;
+
+        len = snprintf(line, sizeof(line), "# %s\nball_count,samples", label);
+
+        for (uint32_t stage = 0; stage < TIMING_STAGE_COUNT; stage++) {
+                len += snprintf(&line[len], sizeof(line) - len, ",%s_ms",
+                    _stage_names[stage]);
+        }
+
+        len += snprintf(&line[len], sizeof(line) - len, "\n");
+
+        for (int i = 0; i < len; i++) {
+                usb_cart_byte_send(line[i]);
+        }
+
+        for (uint32_t ball_count = 0; ball_count <= BALL_MAX_COUNT; ball_count++) {
+                const struct timing_row * const row = &_rows[ball_count];
+
+                if (row->samples == 0) {
+                        continue;
+                }
+
+                len = snprintf(line, sizeof(line), "%lu,%lu", ball_count,
+                    row->samples);
+
+                for (uint32_t stage = 0; stage < TIMING_STAGE_COUNT; stage++) {
+                        const uint32_t us =
+                            _ticks_us_convert(row->ticks[stage] / row->samples);
+
+                        len += snprintf(&line[len], sizeof(line) - len,
+                            ",%lu.%03lu", us / 1000, us % 1000);
+                }
+
+                len += snprintf(&line[len], sizeof(line) - len, "\n");
+
+                for (int i = 0; i < len; i++) {
+                        usb_cart_byte_send(line[i]);
+                }
+        }
+#endif /* TIMING_USB_CART */
+}
+
+static uint32_t
+_ticks_us_convert(uint32_t ticks)
+{
+        return (ticks * 1000) / TIMING_COUNT_1MS;
+}
@@ -0,0 +1,42 @@
+/*
+ * Copyright (c) 2012-2019 Israel Jacquez
+ * See LICENSE for details.
+ *
+ * Israel Jacquez <mrkotfw@gmail.com>
+ */
+
+#ifndef TIMING_H
+#define TIMING_H
+
+#include <yaul.h>
+
+#define TIMING_STAGE_UPDATE     0
+#define TIMING_STAGE_CLAMP      1
+#define TIMING_STAGE_EMIT       2
+#define TIMING_STAGE_PUT        3
+#define TIMING_STAGE_SYNC       4
+#define TIMING_STAGE_COUNT      5
+
+/* Number of frames averaged in the HUD. Must be a power of 2 */
+#define TIMING_WINDOW_COUNT     32
+
+/* Expects the CPU FRT to be running with CPU_FRT_CLOCK_DIV_32. A single stage
+ * must not take longer than one FRT period (~73ms) */
+void timing_init(void);
+void timing_reset(void);
+
+void timing_stage_begin(void);
+void timing_stage_end(uint8_t stage);
+
+/* Rename a stage in the HUD and in the CSV header */
+void timing_stage_name_set(uint8_t stage, const char *name);
+
+void timing_frame_end(uint16_t ball_count);
+
+void timing_hud_print(void);
+
+/* Dump the average time of each stage per ball count as CSV over the USB
+ * cartridge. Does nothing if the example wasn't built for it */
+void timing_csv_dump(const char *label);
+
+#endif /* !TIMING_H */
@@ -12,6 +12,7 @@
 
 #include "vdp1-balls.h"
 #include "balls.h"
+#include "timing.h"
 #include "q0_12_4.h"
 
 #define ORDER_SYSTEM_CLIP_COORDS_INDEX  (0)
@@ -39,11 +40,25 @@
 
 #define BALL_SPEED (0x000E)
 
+#define BALL_LAYOUT     BALLS_LAYOUT_AOS /* BALLS_LAYOUT_AOS or BALLS_LAYOUT_SOA */
+
+#define UPDATE_MODE_MULTI_PASS  0
+#define UPDATE_MODE_FUSED       1
+#define UPDATE_MODE_DUAL        2
+#define UPDATE_MODE_PATCH       3
+
 extern uint8_t root_romdisk[];
 
 void *_romdisk;
 
+#if BALL_LAYOUT == BALLS_LAYOUT_AOS
 static struct ball _balls[BALL_MAX_COUNT] __aligned(0x1000);
+#else
+/* Align each array to a cache line (16 bytes) */
+static q0_12_4_t _balls_pos_x[BALL_MAX_COUNT] __aligned(16);
+static q0_12_4_t _balls_pos_y[BALL_MAX_COUNT] __aligned(16);
+static q0_12_4_t _balls_speed[BALL_MAX_COUNT] __aligned(16);
+#endif /* BALL_LAYOUT */
 static struct balls_config _balls_config;
 
 static balls_handle_t _balls_handle;
@@ -56,7 +71,10 @@ static void _hardware_init(void);
 static void _romdisk_init(void);
 static void _cmdt_list_init(void);
 
+static void _put_stage_name_set(uint8_t update_mode);
+
 static void _vblank_out_handler(void *);
+static void _cmdt_patch_put_handler(void *);
 static void _cpu_frt_ovi_handler(void);
 
 int
@@ -82,7 +100,15 @@ main(void)
         void *pal_base;
         pal_base = (void *)VDP2_CRAM_MODE_1_OFFSET(0, 1, 0x0000);
 
+#if BALL_LAYOUT == BALLS_LAYOUT_AOS
+        _balls_config.layout = BALLS_LAYOUT_AOS;
         _balls_config.balls = _balls;
+#else
+        _balls_config.layout = BALLS_LAYOUT_SOA;
+        _balls_config.pos_x = _balls_pos_x;
+        _balls_config.pos_y = _balls_pos_y;
+        _balls_config.speed = _balls_speed;
+#endif /* BALL_LAYOUT */
         _balls_config.count = BALL_MAX_COUNT;
         _balls_config.sprite_tex_base = tex_base;
         _balls_config.sprite_pal_base = pal_base;
@@ -95,13 +121,27 @@ main(void)
         dma_queue_flush(DMA_QUEUE_TAG_IMMEDIATE);
 
         for (uint32_t i = 0; i < _balls_config.count; i++) {
+#if BALL_LAYOUT == BALLS_LAYOUT_AOS
                 _balls[i].pos_x = 0;
                 _balls[i].pos_y = 0;
                 _balls[i].speed = BALL_SPEED;
+#else
+                _balls_pos_x[i] = 0;
+                _balls_pos_y[i] = 0;
+                _balls_speed[i] = BALL_SPEED;
+#endif /* BALL_LAYOUT */
         }
 
         balls_cmdt_list_init(_balls_handle, cmdts, BALL_MAX_COUNT);
 
+        vdp1_cmdt_t *vram_cmdts;
+        vram_cmdts = (vdp1_cmdt_t *)VDP1_VRAM(ORDER_BALL_START_INDEX *
+            sizeof(vdp1_cmdt_t));
+
+        balls_cmdt_patch_init(_balls_handle, vram_cmdts);
+
+        balls_dual_init();
+
         dma_queue_flush_wait();
 
         const uint8_t sync_modes[] = {
@@ -112,9 +152,36 @@ main(void)
         uint8_t sync_mode;
         sync_mode = 0;
 
+        static const uint8_t update_modes[] = {
+#if BALL_LAYOUT == BALLS_LAYOUT_AOS
+                UPDATE_MODE_MULTI_PASS,
+#endif /* BALL_LAYOUT */
+                UPDATE_MODE_FUSED,
+                UPDATE_MODE_DUAL,
+                UPDATE_MODE_PATCH
+        };
+
+        static const char *update_mode_names[] = {
+                [UPDATE_MODE_MULTI_PASS] = "multi-pass",
+                [UPDATE_MODE_FUSED]      = "fused",
+                [UPDATE_MODE_DUAL]       = "dual",
+                [UPDATE_MODE_PATCH]      = "patch"
+        };
+
+        uint8_t update_mode;
+        update_mode = 0;
+
         uint32_t ball_count;
         ball_count = 1;
 
+        /* Ball count of the last full command table list upload */
+        uint32_t put_ball_count;
+        put_ball_count = 0;
+
+        timing_init();
+
+        _put_stage_name_set(update_modes[update_mode]);
+
         while (true) {
                 smpc_peripheral_process();
                 smpc_peripheral_digital_port(1, &_digital);
@@ -137,25 +204,102 @@ main(void)
                         ball_count = 1;
                 }
 
-                balls_position_update(_balls_handle, ball_count);
-                balls_position_clamp(_balls_handle, ball_count);
-                balls_cmdt_list_update(_balls_handle, cmdts, ball_count);
+                if ((_digital.held.button.y) != 0) {
+                        update_mode++;
+
+                        if (update_mode >= sizeof(update_modes)) {
+                                update_mode = 0;
+                        }
+
+                        /* Don't mix the timings of different modes */
+                        timing_reset();
+
+                        _put_stage_name_set(update_modes[update_mode]);
+                }
+
+                if ((_digital.pressed.button.z) != 0) {
+                        timing_csv_dump(update_mode_names[update_modes[update_mode]]);
+                }
+
+                bool patch;
+                patch = false;
+
+                /* The single pass modes charge all of their work to the
+                 * update stage */
+                timing_stage_begin();
+
+                switch (update_modes[update_mode]) {
+                case UPDATE_MODE_MULTI_PASS:
+                        balls_position_update(_balls_handle, ball_count);
+                        timing_stage_end(TIMING_STAGE_UPDATE);
+                        balls_position_clamp(_balls_handle, ball_count);
+                        timing_stage_end(TIMING_STAGE_CLAMP);
+                        balls_cmdt_list_update(_balls_handle, cmdts, ball_count);
+                        timing_stage_end(TIMING_STAGE_EMIT);
+                        break;
+                case UPDATE_MODE_FUSED:
+                        balls_fused_update(_balls_handle, cmdts, ball_count);
+                        timing_stage_end(TIMING_STAGE_UPDATE);
+                        break;
+                case UPDATE_MODE_DUAL:
+                        balls_dual_update(_balls_handle, cmdts, ball_count);
+                        timing_stage_end(TIMING_STAGE_UPDATE);
+                        break;
+                case UPDATE_MODE_PATCH:
+                        /* The end command table moves with the ball count, so
+                         * fall back to a full upload whenever it changes */
+                        if (ball_count != put_ball_count) {
+                                balls_fused_update(_balls_handle, cmdts, ball_count);
+                                timing_stage_end(TIMING_STAGE_UPDATE);
+                                break;
+                        }
+
+                        balls_cmdt_patch_update(_balls_handle, ball_count);
+                        timing_stage_end(TIMING_STAGE_UPDATE);
+
+                        patch = true;
+                        break;
+                }
+
+                if (patch) {
+                        /* Only the clipping and local coordinate tables are
+                         * put. The ball tables already in VRAM follow them,
+                         * and are patched once the list is transferred */
+                        _cmdt_list->count = ORDER_BALL_START_INDEX;
+
+                        vdp1_sync_cmdt_list_put(_cmdt_list,
+                            _cmdt_patch_put_handler, (void *)(uintptr_t)ball_count);
+                } else {
+                        /* End the command table list */
+                        vdp1_cmdt_end_set(&cmdts[ball_count]);
+
+                        _cmdt_list->count = 2 + ball_count + 1;
 
-                /* End the command table list */
-                vdp1_cmdt_end_set(&cmdts[ball_count]);
+                        put_ball_count = ball_count;
 
-                _cmdt_list->count = 2 + ball_count + 1;
+                        vdp1_sync_cmdt_list_put(_cmdt_list, NULL, NULL);
+                }
 
-                vdp1_sync_cmdt_list_put(_cmdt_list, NULL, NULL);
+                timing_stage_end(TIMING_STAGE_PUT);
 
                 dbgio_printf("[H[2J"
-                             "ball_count: %lu\n",
-                             ball_count);
+                             "ball_count: %lu\n"
+                             "mode: %s\n"
+                             "\n",
+                             ball_count,
+                             update_mode_names[update_modes[update_mode]]);
+
+                timing_hud_print();
 
                 dbgio_flush();
 
+                timing_stage_begin();
+
                 vdp2_tvmd_vblank_in_wait();
                 vdp_sync();
+
+                timing_stage_end(TIMING_STAGE_SYNC);
+                timing_frame_end(ball_count);
         }
 
         return 0;
@@ -186,6 +330,8 @@ _hardware_init(void)
 
         cpu_intc_mask_set(0);
 
+        cpu_dual_init(CPU_DUAL_ENTRY_ICI);
+
         vdp2_tvmd_display_set();
 
         vdp1_env_set(&vdp1_env);
@@ -230,12 +376,38 @@ _cmdt_list_init(void)
             CMDT_VTX_LOCAL_COORD, &local_coords);
 }
 
+static void
+_put_stage_name_set(uint8_t update_mode)
+{
+        /* The patch is transferred from the VDP1 sync callback, so its time
+         * is charged to the sync stage. Only queueing the list is measured
+         * here */
+        if (update_mode == UPDATE_MODE_PATCH) {
+                timing_stage_name_set(TIMING_STAGE_PUT, "enqueue");
+        } else {
+                timing_stage_name_set(TIMING_STAGE_PUT, "put");
+        }
+}
+
 static void
 _vblank_out_handler(void *work __unused)
 {
         smpc_peripheral_intback_issue();
 }
 
+/* The command table list is only transferred once VDP1 is done drawing, so
+ * this is the earliest the ball tables can be patched without VDP1 reading a
+ * mix of old and new positions */
+static void
+_cmdt_patch_put_handler(void *work)
+{
+        const uint32_t ball_count = (uintptr_t)work;
+
+        balls_cmdt_patch_put(_balls_handle, ball_count, DMA_QUEUE_TAG_IMMEDIATE);
+
+        dma_queue_flush(DMA_QUEUE_TAG_IMMEDIATE);
+}
+
 static void
 _cpu_frt_ovi_handler(void)
 {
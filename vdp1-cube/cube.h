@@ -21,9 +21,12 @@
 
 #include <sys/queue.h>
 
+#include "radix_sort.h"
+
 #include "common.h"
 #include "matrix_stack.h"
 #include "sort.h"
+#include "transform_dsp.h"
 
 #include "model_plane.h"
 #include "model_cube.h"
@@ -9,16 +9,56 @@
 
 #include "matrix_stack.h"
 
-SLIST_HEAD(matrix_stacks, matrix_stack);
-
-MEMB(_matrix_stack_pool, struct matrix_stack, MATRIX_STACK_DEPTH,
-    sizeof(struct matrix_stack));
-MEMB(_matrix_stack_matrix_pool, fix16_matrix4_t, MATRIX_STACK_DEPTH,
-    sizeof(fix16_matrix4_t));
+static fix16_matrix4_t _projection_matrices[MATRIX_STACK_PROJECTION_DEPTH] __aligned(16);
+static fix16_matrix4_t _model_view_matrices[MATRIX_STACK_MODEL_VIEW_DEPTH] __aligned(16);
 
 static bool _initialized;
 static int32_t _mode;
-static struct matrix_stacks _matrix_stacks[MATRIX_STACK_MODES];
+static struct matrix_stack _matrix_stacks[MATRIX_STACK_MODES];
+
+static inline void __always_inline
+_matrix_copy(fix16_matrix4_t *dst, const fix16_matrix4_t *src)
+{
+        uint32_t *dst_p;
+        dst_p = (uint32_t *)dst;
+
+        const uint32_t *src_p;
+        src_p = (const uint32_t *)src;
+
+        /* Unrolled so that the matrix moves as back-to-back 32-bit
+         * loads/stores rather than through memcpy() */
+        dst_p[0] = src_p[0];
+        dst_p[1] = src_p[1];
+        dst_p[2] = src_p[2];
+        dst_p[3] = src_p[3];
+        dst_p[4] = src_p[4];
+        dst_p[5] = src_p[5];
+        dst_p[6] = src_p[6];
+        dst_p[7] = src_p[7];
+        dst_p[8] = src_p[8];
+        dst_p[9] = src_p[9];
+        dst_p[10] = src_p[10];
+        dst_p[11] = src_p[11];
+        dst_p[12] = src_p[12];
+        dst_p[13] = src_p[13];
+        dst_p[14] = src_p[14];
+        dst_p[15] = src_p[15];
+}
+
+static inline fix16_matrix4_t * __always_inline
+_matrix_top(void)
+{
+#ifdef ASSERT
+        /* Make sure the correct state is set */
+        assert(_initialized);
+        assert(_mode != MATRIX_STACK_MODE_INVALID);
+#endif /* ASSERT */
+
+        struct matrix_stack *ms;
+        ms = &_matrix_stacks[_mode];
+
+        return &ms->ms_matrices[ms->ms_top];
+}
 
 void
 matrix_stack_init(void)
@@ -27,21 +67,25 @@ matrix_stack_init(void)
                 return;
         }
 
-        SLIST_INIT(&_matrix_stacks[MATRIX_STACK_MODE_PROJECTION]);
-        SLIST_INIT(&_matrix_stacks[MATRIX_STACK_MODE_MODEL_VIEW]);
+        _matrix_stacks[MATRIX_STACK_MODE_PROJECTION].ms_matrices =
+            _projection_matrices;
+        _matrix_stacks[MATRIX_STACK_MODE_PROJECTION].ms_depth =
+            MATRIX_STACK_PROJECTION_DEPTH;
+        _matrix_stacks[MATRIX_STACK_MODE_PROJECTION].ms_top = 0;
 
-        memb_init(&_matrix_stack_pool);
-        memb_init(&_matrix_stack_matrix_pool);
+        _matrix_stacks[MATRIX_STACK_MODE_MODEL_VIEW].ms_matrices =
+            _model_view_matrices;
+        _matrix_stacks[MATRIX_STACK_MODE_MODEL_VIEW].ms_depth =
+            MATRIX_STACK_MODEL_VIEW_DEPTH;
+        _matrix_stacks[MATRIX_STACK_MODE_MODEL_VIEW].ms_top = 0;
 
         _initialized = true;
         _mode = MATRIX_STACK_MODE_INVALID;
 
         matrix_stack_mode(MATRIX_STACK_MODE_PROJECTION);
-        matrix_stack_push();
         matrix_stack_identity_load();
 
         matrix_stack_mode(MATRIX_STACK_MODE_MODEL_VIEW);
-        matrix_stack_push();
         matrix_stack_identity_load();
 }
 
@@ -63,21 +107,15 @@ matrix_stack_push(void)
         assert(_mode != MATRIX_STACK_MODE_INVALID);
 
         struct matrix_stack *ms;
-        ms = (struct matrix_stack *)memb_alloc(&_matrix_stack_pool);
-
-        struct matrix_stack *top_ms;
-        top_ms = matrix_stack_top(_mode);
+        ms = &_matrix_stacks[_mode];
 
-        ms->ms_matrix = (fix16_matrix4_t *)memb_alloc(
-                &_matrix_stack_matrix_pool);
-        assert(ms->ms_matrix != NULL);
+        /* Make sure we don't overflow the stack */
+        assert((ms->ms_top + 1) < ms->ms_depth);
 
-        if (top_ms != NULL) {
-                memcpy(ms->ms_matrix, top_ms->ms_matrix,
-                    sizeof(fix16_matrix4_t));
-        }
+        _matrix_copy(&ms->ms_matrices[ms->ms_top + 1],
+            &ms->ms_matrices[ms->ms_top]);
 
-        SLIST_INSERT_HEAD(&_matrix_stacks[_mode], ms, ms_entries);
+        ms->ms_top++;
 }
 
 void
@@ -87,22 +125,16 @@ matrix_stack_pop(void)
         assert(_initialized);
         assert(_mode != MATRIX_STACK_MODE_INVALID);
 
-        struct matrix_stack *top_ms;
-        top_ms = matrix_stack_top(_mode);
-        assert(top_ms != NULL);
-
-        int error_code __unused;
-        error_code = memb_free(&_matrix_stack_matrix_pool, top_ms->ms_matrix);
-        assert(error_code == 0);
-        error_code = memb_free(&_matrix_stack_pool, top_ms);
-        assert(error_code == 0);
-        SLIST_REMOVE_HEAD(&_matrix_stacks[_mode], ms_entries);
+        struct matrix_stack *ms;
+        ms = &_matrix_stacks[_mode];
 
         /* Make sure we didn't pop off the last matrix in the stack */
-        assert(!(SLIST_EMPTY(&_matrix_stacks[_mode])));
+        assert(ms->ms_top > 0);
+
+        ms->ms_top--;
 }
 
-struct matrix_stack *
+fix16_matrix4_t *
 matrix_stack_top(int32_t mode)
 {
         /* Make sure the correct state is set */
@@ -110,171 +142,127 @@ matrix_stack_top(int32_t mode)
         assert((mode == MATRIX_STACK_MODE_PROJECTION) ||
                (mode == MATRIX_STACK_MODE_MODEL_VIEW));
 
-        return SLIST_FIRST(&_matrix_stacks[mode]);
+        struct matrix_stack *ms;
+        ms = &_matrix_stacks[mode];
+
+        return &ms->ms_matrices[ms->ms_top];
 }
 
 void
-matrix_stack_load(fix16_matrix4_t *matrix)
+matrix_stack_load(const fix16_matrix4_t *matrix)
 {
-        /* Make sure the correct state is set */
-        assert(_initialized);
-        assert(_mode != MATRIX_STACK_MODE_INVALID);
-
-        struct matrix_stack *top_ms;
-        top_ms = matrix_stack_top(_mode);
-        assert(top_ms != NULL);
-
-        memcpy(top_ms->ms_matrix, matrix, sizeof(fix16_matrix4_t));
+        _matrix_copy(_matrix_top(), matrix);
 }
 
 void
 matrix_stack_identity_load(void)
 {
-        /* Make sure the correct state is set */
-        assert(_initialized);
-        assert(_mode != MATRIX_STACK_MODE_INVALID);
-
-        struct matrix_stack *top_ms;
-        top_ms = matrix_stack_top(_mode);
-        assert(top_ms != NULL);
-
-        fix16_matrix4_identity(top_ms->ms_matrix);
+        fix16_matrix4_identity(_matrix_top());
 }
 
 void
 matrix_stack_translate(fix16_t x, fix16_t y, fix16_t z)
 {
-#ifdef ASSERT
-        /* Make sure the correct state is set */
-        assert(_initialized);
-        assert(_mode != MATRIX_STACK_MODE_INVALID);
-#endif /* ASSERT */
-
-        struct matrix_stack *top_ms;
-        top_ms = matrix_stack_top(_mode);
-#ifdef ASSERT
-        assert(top_ms != NULL);
-#endif /* ASSERT */
-
-        fix16_matrix4_t transform;
-        fix16_matrix4_identity(&transform);
-
-        transform.frow[0][3] = x;
-        transform.frow[1][3] = y;
-        transform.frow[2][3] = z;
-
-        fix16_matrix4_t matrix;
-        fix16_matrix4_multiply(top_ms->ms_matrix, &transform, &matrix);
-
-        matrix_stack_load(&matrix);
+        fix16_matrix4_t *matrix;
+        matrix = _matrix_top();
+
+        /* M * T only changes the last column */
+        uint32_t row;
+        for (row = 0; row < 4; row++) {
+                fix16_t *frow;
+                frow = matrix->frow[row];
+
+                frow[3] = fix16_add(frow[3], fix16_add(fix16_add(
+                                fix16_mul(frow[0], x),
+                                fix16_mul(frow[1], y)),
+                        fix16_mul(frow[2], z)));
+        }
 }
 
 void
 matrix_stack_scale(fix16_t x, fix16_t y, fix16_t z)
 {
-#ifdef ASSERT
-        /* Make sure the correct state is set */
-        assert(_initialized);
-        assert(_mode != MATRIX_STACK_MODE_INVALID);
-#endif /* ASSERT */
-
-        struct matrix_stack *top_ms;
-        top_ms = matrix_stack_top(_mode);
-
-#ifdef ASSERT
-        assert(top_ms != NULL);
-#endif /* ASSERT */
-
-        fix16_matrix4_t transform;
-        fix16_matrix4_identity(&transform);
-
-        transform.frow[0][0] = x;
-        transform.frow[1][1] = y;
-        transform.frow[2][2] = z;
-
-        fix16_matrix4_t matrix;
-        fix16_matrix4_multiply(top_ms->ms_matrix, &transform, &matrix);
-
-        matrix_stack_load(&matrix);
+        fix16_matrix4_t *matrix;
+        matrix = _matrix_top();
+
+        /* M * S scales the first three columns */
+        uint32_t row;
+        for (row = 0; row < 4; row++) {
+                fix16_t *frow;
+                frow = matrix->frow[row];
+
+                frow[0] = fix16_mul(frow[0], x);
+                frow[1] = fix16_mul(frow[1], y);
+                frow[2] = fix16_mul(frow[2], z);
+        }
 }
 
 void
 matrix_stack_rotate(fix16_t angle, int32_t component)
 {
-#ifdef ASSERT
-        /* Make sure the correct state is set */
-        assert(_initialized);
-        assert(_mode != MATRIX_STACK_MODE_INVALID);
+        fix16_t sin;
+        sin = fix16_sin(fix16_deg_to_rad(angle));
+        fix16_t cos;
+        cos = fix16_cos(fix16_deg_to_rad(angle));
 
-        assert((component >= 0) && (component <= 2));
-#endif /* ASSERT */
+        matrix_stack_rotate_sin_cos(sin, cos, component);
+}
 
-        struct matrix_stack *top_ms;
-        top_ms = matrix_stack_top(_mode);
+void
+matrix_stack_rotate_sin_cos(fix16_t sin, fix16_t cos, int32_t component)
+{
 #ifdef ASSERT
-        assert(top_ms != NULL);
+        assert((component >= MATRIX_STACK_AXIS_X) &&
+               (component <= MATRIX_STACK_AXIS_Z));
 #endif /* ASSERT */
 
-        fix16_matrix4_t transform;
-        fix16_matrix4_identity(&transform);
+        fix16_matrix4_t *matrix;
+        matrix = _matrix_top();
 
-        fix16_t sin;
-        sin = fix16_sin(fix16_deg_to_rad(angle));
-        fix16_t cos;
-        cos = fix16_cos(fix16_deg_to_rad(angle));
+        /* M * R only mixes the two columns spanning the plane of rotation */
+        uint32_t col_a;
+        uint32_t col_b;
 
         switch (component) {
-        case 0: /* X */
-                transform.frow[1][1] = cos;
-                transform.frow[1][2] = -sin;
-                transform.frow[2][1] = sin;
-                transform.frow[2][2] = cos;
+        case MATRIX_STACK_AXIS_X:
+                col_a = 1;
+                col_b = 2;
                 break;
-        case 1: /* Y */
-                transform.frow[0][0] = cos;
-                transform.frow[0][2] = sin;
-                transform.frow[2][0] = -sin;
-                transform.frow[2][2] = cos;
+        case MATRIX_STACK_AXIS_Y:
+                col_a = 2;
+                col_b = 0;
                 break;
-        case 2: /* Z */
-                transform.frow[0][0] = cos;
-                transform.frow[0][1] = -sin;
-                transform.frow[1][0] = sin;
-                transform.frow[1][1] = cos;
+        case MATRIX_STACK_AXIS_Z:
+        default:
+                col_a = 0;
+                col_b = 1;
                 break;
         }
 
-        fix16_matrix4_t matrix;
-        fix16_matrix4_multiply(top_ms->ms_matrix, &transform, &matrix);
+        uint32_t row;
+        for (row = 0; row < 4; row++) {
+                fix16_t *frow;
+                frow = matrix->frow[row];
 
-        matrix_stack_load(&matrix);
+                const fix16_t a = frow[col_a];
+                const fix16_t b = frow[col_b];
+
+                frow[col_a] = fix16_add(fix16_mul(a, cos), fix16_mul(b, sin));
+                frow[col_b] = fix16_sub(fix16_mul(b, cos), fix16_mul(a, sin));
+        }
 }
 
 void
-matrix_stack_orthographic_project(fix16_t left __unused, fix16_t right __unused, fix16_t top __unused,
-    fix16_t bottom __unused, fix16_t near __unused, fix16_t far __unused)
+matrix_stack_orthographic_project(fix16_t left, fix16_t right, fix16_t top,
+    fix16_t bottom, fix16_t near, fix16_t far)
 {
 #ifdef ASSERT
-        /* Make sure the correct state is set */
-        assert(state._initialized);
-        assert(state._mode != MATRIX_STACK_MODE_INVALID);
-#endif /* ASSERT */
-
-        struct matrix_stack *top_ms;
-        top_ms = matrix_stack_top(_mode);
-
-#ifdef ASSERT
-        assert(top_ms != NULL);
+        assert(near > F16(0.0f));
 #endif /* ASSERT */
 
         fix16_matrix4_t transform;
         fix16_matrix4_identity(&transform);
 
-#ifdef ASSERT
-        assert(near > F16(0.0f));
-#endif /* ASSERT */
-
-
         transform.frow[0][0] = fix16_div(F16(2.0f), fix16_sub(right, left));
         transform.frow[0][3] = fix16_div(-fix16_add(right, left), fix16_sub(right, left));
         transform.frow[1][1] = fix16_div(F16(2.0f), fix16_sub(top, bottom));
@@ -283,7 +271,7 @@ matrix_stack_orthographic_project(fix16_t left __unused, fix16_t right __unused,
         transform.frow[2][3] = fix16_div(-fix16_add(far, near), fix16_sub(far, near));
 
         fix16_matrix4_t matrix;
-        fix16_matrix4_multiply(top_ms->ms_matrix, &transform, &matrix);
+        fix16_matrix4_multiply(_matrix_top(), &transform, &matrix);
 
         matrix_stack_load(&matrix);
 }
@@ -10,10 +10,8 @@
 
 #include <yaul.h>
 
-#define MATRIX_STACK_MODEL_VIEW_DEPTH   3
-#define MATRIX_STACK_PROJECTION_DEPTH   1
-#define MATRIX_STACK_DEPTH              (MATRIX_STACK_MODEL_VIEW_DEPTH +       \
-    MATRIX_STACK_PROJECTION_DEPTH)
+#define MATRIX_STACK_MODEL_VIEW_DEPTH   16
+#define MATRIX_STACK_PROJECTION_DEPTH   2
 
 #define MATRIX_STACK_MODE_INVALID       -1
 #define MATRIX_STACK_MODE_PROJECTION    0
@@ -21,23 +19,28 @@
 
 #define MATRIX_STACK_MODES              2
 
-struct matrix_stack {
-        fix16_matrix4_t *ms_matrix;
+#define MATRIX_STACK_AXIS_X             0
+#define MATRIX_STACK_AXIS_Y             1
+#define MATRIX_STACK_AXIS_Z             2
 
-        SLIST_ENTRY(matrix_stack) ms_entries;
-} __aligned(4);
+struct matrix_stack {
+        fix16_matrix4_t *ms_matrices;
+        int32_t ms_depth;
+        int32_t ms_top;
+};
 
 extern void matrix_stack_init(void);
 extern void matrix_stack_mode(int32_t);
 extern void matrix_stack_push(void);
 extern void matrix_stack_pop(void);
-extern struct matrix_stack *matrix_stack_top(int32_t);
-extern void matrix_stack_load(fix16_matrix4_t *);
+extern fix16_matrix4_t *matrix_stack_top(int32_t);
+extern void matrix_stack_load(const fix16_matrix4_t *);
 
 extern void matrix_stack_identity_load(void);
 extern void matrix_stack_translate(fix16_t, fix16_t, fix16_t);
 extern void matrix_stack_scale(fix16_t, fix16_t, fix16_t);
 extern void matrix_stack_rotate(fix16_t, int32_t);
+extern void matrix_stack_rotate_sin_cos(fix16_t, fix16_t, int32_t);
 
 extern void matrix_stack_orthographic_project(fix16_t, fix16_t, fix16_t, fix16_t, fix16_t, fix16_t);
 
@@ -7,7 +7,7 @@
 
 #include "cube.h"
 
-fix16_vector4_t teapot_vertices[] = {
+fix16_vector4_t teapot_vertices[TEAPOT_VERTEX_BUFFER_CNT] = {
         FIX16_VERTEX4(0.370303f, 0.304443f, 0.142938f, 1.0f),
         FIX16_VERTEX4(0.375425f, 0.283457f, 0.145117f, 1.0f),
         FIX16_VERTEX4(0.406266f, 0.283457f, -0.011080f, 1.0f),
@@ -8,9 +8,12 @@
 #ifndef MODEL_TEAPOT_H_
 #define MODEL_TEAPOT_H_
 
+#define TEAPOT_VERTEX_CNT 530
+/* Padded out to whole batches for transform_dsp_start() */
+#define TEAPOT_VERTEX_BUFFER_CNT 544
 #define TEAPOT_POLYGON_CNT 514
 
-extern fix16_vector4_t teapot_vertices[];
+extern fix16_vector4_t teapot_vertices[TEAPOT_VERTEX_BUFFER_CNT];
 extern uint32_t teapot_indices[TEAPOT_POLYGON_CNT * 4];
 extern fix16_vector4_t teapot_normals[TEAPOT_POLYGON_CNT];
 
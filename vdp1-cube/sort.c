@@ -18,6 +18,10 @@ static struct ot_primitive ot_primitive_pool[OT_PRIMITIVE_CNT];
 
 static uint32_t ot_primitive_pool_idx;
 
+/* Radix sort */
+static radix_sort_pair_t ot_radix_pairs[OT_PRIMITIVE_CNT];
+static struct ot_primitive *ot_radix_primitives[OT_PRIMITIVE_CNT];
+
 void
 ot_init(void)
 {
@@ -35,7 +39,7 @@ ot_bucket_init(int32_t idx)
         struct ot_primitive_bucket *opb;
         opb = &ot_primitive_bucket_pool[idx & (OT_PRIMITIVE_BUCKETS - 1)];
 
-        TAILQ_INIT(&opb->opb_bucket);
+        SLIST_INIT(&opb->opb_bucket);
         opb->opb_count = 0;
 }
 
@@ -48,12 +52,11 @@ ot_bucket(int32_t idx)
 bool
 ot_bucket_empty(int32_t idx)
 {
-        return TAILQ_EMPTY(&ot_primitive_bucket_pool[idx].opb_bucket);
+        return SLIST_EMPTY(&ot_primitive_bucket_pool[idx].opb_bucket);
 }
 
 void
-ot_primitive_add(const fix16_vector4_t *vertex_mv,
-    const fix16_vector4_t *vertex_projected, uint16_t color)
+ot_primitive_add(const struct ot_vertex * const *vertices, uint16_t color)
 {
         struct ot_primitive *otp;
         otp = &ot_primitive_pool[ot_primitive_pool_idx];
@@ -63,48 +66,38 @@ ot_primitive_add(const fix16_vector4_t *vertex_mv,
 
         fix16_t avg;
         avg = fix16_mul(fix16_add(
-                    fix16_add(vertex_mv[0].z, vertex_mv[1].z),
-                    fix16_add(vertex_mv[2].z, vertex_mv[3].z)),
+                    fix16_add(vertices[0]->otv_z, vertices[1]->otv_z),
+                    fix16_add(vertices[2]->otv_z, vertices[3]->otv_z)),
             F16(1.0f / 4.0f));
 
         otp->otp_color = color;
         otp->otp_avg = avg;
 
-        fix16_t half_width;
-        half_width = F16((float)SCREEN_WIDTH / 2.0f);
-
-        fix16_t half_height;
-        half_height = F16((float)-SCREEN_HEIGHT / 2.0f);
-
-        otp->otp_coords[0].x = fix16_to_int(
-                fix16_mul(vertex_projected[0].x, half_width));
-        otp->otp_coords[0].y = fix16_to_int(
-                fix16_mul(vertex_projected[0].y, half_height));
-        otp->otp_coords[1].x = fix16_to_int(
-                fix16_mul(vertex_projected[1].x, half_width));
-        otp->otp_coords[1].y = fix16_to_int(
-                fix16_mul(vertex_projected[1].y, half_height));
-        otp->otp_coords[2].x = fix16_to_int(
-                fix16_mul(vertex_projected[2].x, half_width));
-        otp->otp_coords[2].y = fix16_to_int(
-                fix16_mul(vertex_projected[2].y, half_height));
-        otp->otp_coords[3].x = fix16_to_int(
-                fix16_mul(vertex_projected[3].x, half_width));
-        otp->otp_coords[3].y = fix16_to_int(
-                fix16_mul(vertex_projected[3].y, half_height));
         /* Screen coordinates */
+        otp->otp_coords[0] = vertices[0]->otv_coord;
+        otp->otp_coords[1] = vertices[1]->otv_coord;
+        otp->otp_coords[2] = vertices[2]->otv_coord;
+        otp->otp_coords[3] = vertices[3]->otv_coord;
 
-        fix16_t abs_avg;
-        abs_avg = fix16_abs(avg);
+        fix16_t depth;
+        depth = fix16_sub(fix16_abs(avg), F16(OT_DEPTH_NEAR));
 
         int32_t idx;
-        /* XXX */
-        idx = fix16_to_int(abs_avg);
+        idx = 0;
+
+        if (depth > 0) {
+                idx = fix16_to_int(fix16_mul(depth,
+                        F16(OT_PRIMITIVE_BUCKETS / (OT_DEPTH_FAR - OT_DEPTH_NEAR))));
+
+                if (idx > (OT_PRIMITIVE_BUCKETS - 1)) {
+                        idx = OT_PRIMITIVE_BUCKETS - 1;
+                }
+        }
 
         struct ot_primitive_bucket *opb;
-        opb = &ot_primitive_bucket_pool[idx & (OT_PRIMITIVE_BUCKETS - 1)];
+        opb = &ot_primitive_bucket_pool[idx];
 
-        TAILQ_INSERT_HEAD(&opb->opb_bucket, otp, otp_entries);
+        SLIST_INSERT_HEAD(&opb->opb_bucket, otp, otp_entries);
         opb->opb_count++;
 }
 
@@ -118,26 +111,26 @@ ot_bucket_primitive_sort(int32_t idx, int32_t type)
         struct ot_primitive *otp;
 
         if (type == OT_PRIMITIVE_BUCKET_SORT_INSERTION) {
-                for (otp = TAILQ_FIRST(&ot_primitive_bucket_pool[idx].opb_bucket);
-                     (otp != NULL) && (safe = TAILQ_NEXT(otp, otp_entries), 1);
+                for (otp = SLIST_FIRST(&ot_primitive_bucket_pool[idx].opb_bucket);
+                     (otp != NULL) && (safe = SLIST_NEXT(otp, otp_entries), 1);
                      otp = safe) {
                         struct ot_primitive *otp_current;
                         otp_current = otp;
                         if ((head == NULL) || (otp_current->otp_avg > head->otp_avg)) {
-                                TAILQ_NEXT(otp_current, otp_entries) = head;
+                                SLIST_NEXT(otp_current, otp_entries) = head;
                                 head = otp_current;
-                                TAILQ_FIRST(&ot_primitive_bucket_pool[idx].opb_bucket) = head;
+                                SLIST_FIRST(&ot_primitive_bucket_pool[idx].opb_bucket) = head;
                                 continue;
                         }
 
                         struct ot_primitive *otp_p;
                         for (otp_p = head; otp_p != NULL; ) {
                                 struct ot_primitive **otp_p_next;
-                                otp_p_next = &TAILQ_NEXT(otp_p, otp_entries);
+                                otp_p_next = &SLIST_NEXT(otp_p, otp_entries);
 
                                 if ((*otp_p_next == NULL) ||
                                     (otp_current->otp_avg > (*otp_p_next)->otp_avg)) {
-                                        TAILQ_NEXT(otp_current, otp_entries) =
+                                        SLIST_NEXT(otp_current, otp_entries) =
                                             *otp_p_next;
                                         *otp_p_next = otp_current;
                                         break;
@@ -154,15 +147,15 @@ ot_bucket_primitive_sort(int32_t idx, int32_t type)
                         struct ot_primitive *otp_k __unused;
                         otp_k = NULL;
 
-                        head = TAILQ_FIRST(&ot_primitive_bucket_pool[idx].opb_bucket);
+                        head = SLIST_FIRST(&ot_primitive_bucket_pool[idx].opb_bucket);
                         for (otp = head;
-                             (otp != NULL) && (safe = TAILQ_NEXT(otp, otp_entries), 1);
+                             (otp != NULL) && (safe = SLIST_NEXT(otp, otp_entries), 1);
                              otp = safe) {
                                 struct ot_primitive *otp_i;
                                 otp_i = otp;
 
                                 struct ot_primitive *otp_j;
-                                otp_j = TAILQ_NEXT(otp, otp_entries);
+                                otp_j = SLIST_NEXT(otp, otp_entries);
 
                                 if (otp_j == NULL) {
                                         continue;
@@ -170,16 +163,16 @@ ot_bucket_primitive_sort(int32_t idx, int32_t type)
 
                                 if (otp_j->otp_avg > otp_i->otp_avg) {
                                         if (otp_k == NULL) {
-                                                TAILQ_FIRST(&ot_primitive_bucket_pool[idx].opb_bucket) =
+                                                SLIST_FIRST(&ot_primitive_bucket_pool[idx].opb_bucket) =
                                                     otp_j;
                                         } else {
-                                                TAILQ_NEXT(otp_k, otp_entries) =
+                                                SLIST_NEXT(otp_k, otp_entries) =
                                                     otp_j;
                                         }
 
-                                        TAILQ_NEXT(otp_i, otp_entries) =
-                                            TAILQ_NEXT(otp_j, otp_entries);
-                                        TAILQ_NEXT(otp_j, otp_entries) = otp_i;
+                                        SLIST_NEXT(otp_i, otp_entries) =
+                                            SLIST_NEXT(otp_j, otp_entries);
+                                        SLIST_NEXT(otp_j, otp_entries) = otp_i;
 
                                         swapped = true;
                                 }
@@ -188,5 +181,40 @@ ot_bucket_primitive_sort(int32_t idx, int32_t type)
                         }
                 } while (swapped);
         } else if (type == OT_PRIMITIVE_BUCKET_SORT_QUICK) {
+        } else if (type == OT_PRIMITIVE_BUCKET_SORT_RADIX) {
+                struct ot_primitive_bucket *opb;
+                opb = &ot_primitive_bucket_pool[idx];
+
+                uint32_t count;
+                count = 0;
+
+                SLIST_FOREACH (otp, &opb->opb_bucket, otp_entries) {
+                        fix16_t depth;
+                        depth = fix16_abs(otp->otp_avg) >> 4;
+
+                        if (depth > 0xFFFF) {
+                                depth = 0xFFFF;
+                        }
+
+                        /* Farthest first, so invert the key for the
+                         * ascending radix sort */
+                        ot_radix_pairs[count].depth = 0xFFFF - depth;
+                        ot_radix_pairs[count].index = count;
+                        ot_radix_primitives[count] = otp;
+
+                        count++;
+                }
+
+                radix_sort(ot_radix_pairs, count);
+
+                /* Relink back to front */
+                SLIST_INIT(&opb->opb_bucket);
+
+                int32_t pair_idx;
+                for (pair_idx = count - 1; pair_idx >= 0; pair_idx--) {
+                        otp = ot_radix_primitives[ot_radix_pairs[pair_idx].index];
+
+                        SLIST_INSERT_HEAD(&opb->opb_bucket, otp, otp_entries);
+                }
         }
 }
@@ -10,26 +10,48 @@
 
 #include "cube.h"
 
-#define OT_PRIMITIVE_BUCKETS    1
-#define OT_PRIMITIVE_CNT        VDP1_CMDT_COUNT_MAX
+/* Primitives are binned by the absolute value of their average Z. The
+ * teapot is about a unit in radius and translated 10 units away (see
+ * vdp1-cube.c), so the 256 buckets are spread across [OT_DEPTH_NEAR,
+ * OT_DEPTH_FAR), at 1/128 of a unit each. Depths outside of that range are
+ * clamped to the first or last bucket */
+#define OT_PRIMITIVE_BUCKETS            256
+#define OT_PRIMITIVE_CNT                VDP1_CMDT_COUNT_MAX
+
+#define OT_DEPTH_NEAR                   9.0f
+#define OT_DEPTH_FAR                    11.0f
 
 #define OT_PRIMITIVE_BUCKET_SORT_INSERTION      0
 #define OT_PRIMITIVE_BUCKET_SORT_BUBBLE         1
 #define OT_PRIMITIVE_BUCKET_SORT_QUICK          2
+#define OT_PRIMITIVE_BUCKET_SORT_RADIX          3
+
+SLIST_HEAD(ot_primitive_head, ot_primitive);
+
+/* Clip codes, one bit per plane the vertex lies outside of */
+#define OT_VERTEX_CLIP_LEFT     0x01
+#define OT_VERTEX_CLIP_RIGHT    0x02
+#define OT_VERTEX_CLIP_TOP      0x04
+#define OT_VERTEX_CLIP_BOTTOM   0x08
+#define OT_VERTEX_CLIP_NEAR     0x10
 
-TAILQ_HEAD(ot_primitive_head, ot_primitive);
+/* Transformed vertex, shared by every primitive that references it */
+struct ot_vertex {
+        fix16_t otv_z;
+        int16_vector2_t otv_coord;
+        uint8_t otv_clip;
+} __aligned(4);
 
 struct ot_primitive {
         uint16_t otp_color;
         fix16_t otp_avg;
         int16_vector2_t otp_coords[4];
 
-        TAILQ_ENTRY(ot_primitive) otp_entries;
+        SLIST_ENTRY(ot_primitive) otp_entries;
 } __aligned(32);
 
 extern void ot_init(void);
-extern void ot_primitive_add(const fix16_vector4_t *, const fix16_vector4_t *,
-    uint16_t);
+extern void ot_primitive_add(const struct ot_vertex * const *, uint16_t);
 extern void ot_bucket_init(int32_t);
 extern struct ot_primitive_head *ot_bucket(int32_t);
 extern bool ot_bucket_empty(int32_t);
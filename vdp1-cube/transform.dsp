@@ -0,0 +1,80 @@
+; Transforms batches of 16 fix16_vector4_t vertices by a 3x4 fix16 matrix
+;
+; MC0: Input batch, 16 vertices (X, Y, Z, W), DMA'd from D0
+; MC1: 3x4 matrix (row major) at 0..11, the constant 1 at 12
+; MC2: Output batch, planar: 16 X, then 16 Y, then 16 Z
+; MC3: [0] Batch count, [2] RA0 (source >> 2), [3] WA0 (destination >> 2)
+;
+; Each row is a multiply-accumulate of 4 products. The 48-bit product of two
+; 16.16 values leaves the 16.16 result in ALH
+
+Start:
+; ALU           X-bus                           Y-bus                           D1-bus
+  NOP           NOP                             NOP                             MOV 2, CT3
+  NOP           NOP                             NOP                             MOV MC3, RA0
+  NOP           NOP                             NOP                             MOV MC3, WA0
+
+Batch:
+  NOP           NOP                             NOP                             MOV 0, CT0
+  DMA D0, MC0, 64
+WaitIn:
+  JMP T0, WaitIn
+  NOP
+  NOP           NOP                             NOP                             MOV 0, CT2
+
+; Row 0
+  NOP           NOP                             NOP                             MOV 0, CT1
+  NOP           NOP                             NOP                             MOV 15, LOP
+  NOP           NOP                             NOP                             MOV Row0, TOP
+Row0:
+  NOP           MOV MC1, X                      MOV MC0, Y CLR A                NOP
+  NOP           MOV MC1, X MOV MUL, P           MOV MC0, Y                      NOP
+  AD2           MOV MC1, X MOV MUL, P           MOV MC0, Y MOV ALU, A           NOP
+  AD2           MOV MC1, X MOV MUL, P           MOV MC0, Y MOV ALU, A           NOP
+  AD2           MOV MUL, P                      MOV ALU, A                      MOV 0, CT1
+  AD2           NOP                             NOP                             MOV ALH, MC2
+  BTM
+  NOP
+
+; Row 1
+  NOP           NOP                             NOP                             MOV 4, CT1
+  NOP           NOP                             NOP                             MOV 15, LOP
+  NOP           NOP                             NOP                             MOV Row1, TOP
+Row1:
+  NOP           MOV MC1, X                      MOV MC0, Y CLR A                NOP
+  NOP           MOV MC1, X MOV MUL, P           MOV MC0, Y                      NOP
+  AD2           MOV MC1, X MOV MUL, P           MOV MC0, Y MOV ALU, A           NOP
+  AD2           MOV MC1, X MOV MUL, P           MOV MC0, Y MOV ALU, A           NOP
+  AD2           MOV MUL, P                      MOV ALU, A                      MOV 4, CT1
+  AD2           NOP                             NOP                             MOV ALH, MC2
+  BTM
+  NOP
+
+; Row 2
+  NOP           NOP                             NOP                             MOV 8, CT1
+  NOP           NOP                             NOP                             MOV 15, LOP
+  NOP           NOP                             NOP                             MOV Row2, TOP
+Row2:
+  NOP           MOV MC1, X                      MOV MC0, Y CLR A                NOP
+  NOP           MOV MC1, X MOV MUL, P           MOV MC0, Y                      NOP
+  AD2           MOV MC1, X MOV MUL, P           MOV MC0, Y MOV ALU, A           NOP
+  AD2           MOV MC1, X MOV MUL, P           MOV MC0, Y MOV ALU, A           NOP
+  AD2           MOV MUL, P                      MOV ALU, A                      MOV 8, CT1
+  AD2           NOP                             NOP                             MOV ALH, MC2
+  BTM
+  NOP
+
+  NOP           NOP                             NOP                             MOV 0, CT2
+  DMA MC2, D0, 48
+WaitOut:
+  JMP T0, WaitOut
+  NOP
+
+; Decrement the batch count
+  NOP           NOP                             NOP                             MOV 0, CT3
+  NOP           NOP                             NOP                             MOV 12, CT1
+  NOP           MOV M1, P                       MOV M3, A                       NOP
+  SUB           NOP                             NOP                             MOV ALL, MC3
+  JMP NZ, Batch
+  NOP
+  ENDI
@@ -0,0 +1,161 @@
+/*
+ * Copyright (c) 2012-2019 Israel Jacquez
+ * See LICENSE for details.
+ *
+ * Israel Jacquez <mrkotfw@gmail.com>
+ */
+
+#include <assert.h>
+
+#include "transform_dsp.h"
+
+#define TRANSFORM_DSP_MATRIX_ROWS       3
+#define TRANSFORM_DSP_MATRIX_WORDS      (TRANSFORM_DSP_MATRIX_ROWS * 4)
+
+/* The Z of the last vertex is the last word written back in each batch. It's
+ * set to this value beforehand, which no transformed vertex comes close to, so
+ * the batch has landed once it changes */
+#define TRANSFORM_DSP_BATCH_PENDING     ((fix16_t)0x80000000)
+
+static const uint32_t _program[] = {
+        /* See transform.dsp */
+        0x00001F02, /* Start */
+        0x00003607,
+        0x00003707,
+        0x00001C00, /* Batch */
+        0xC0008040,
+        0xD3400005, /* WaitIn */
+        0x00000000,
+        0x00001E00,
+        0x00001D00, /* Row 0 */
+        0x00001A0F,
+        0x00001B0B,
+        0x025B0000,
+        0x03590000,
+        0x1B5D0000,
+        0x1B5D0000,
+        0x19041D00,
+        0x1800320A,
+        0xE0000000,
+        0x00000000,
+        0x00001D04, /* Row 1 */
+        0x00001A0F,
+        0x00001B16,
+        0x025B0000,
+        0x03590000,
+        0x1B5D0000,
+        0x1B5D0000,
+        0x19041D04,
+        0x1800320A,
+        0xE0000000,
+        0x00000000,
+        0x00001D08, /* Row 2 */
+        0x00001A0F,
+        0x00001B21,
+        0x025B0000,
+        0x03590000,
+        0x1B5D0000,
+        0x1B5D0000,
+        0x19041D08,
+        0x1800320A,
+        0xE0000000,
+        0x00000000,
+        0x00001E00,
+        0xC0009230,
+        0xD340002B, /* WaitOut */
+        0x00000000,
+        0x00001F00,
+        0x00001D0C,
+        0x0196C000,
+        0x14003309,
+        0xD2080003,
+        0x00000000,
+        0xF8000000
+};
+
+static struct transform_dsp_batch _batches[
+        TRANSFORM_DSP_BATCH_CNT(TRANSFORM_DSP_VERTEX_CNT_MAX)];
+
+static uint32_t _batch_cnt;
+
+static inline volatile struct transform_dsp_batch *
+_batch_through(uint32_t idx)
+{
+        /* The DSP writes the results behind the back of the cache */
+        return (volatile struct transform_dsp_batch *)(CPU_CACHE_THROUGH |
+            (uint32_t)&_batches[idx]);
+}
+
+void
+transform_dsp_init(void)
+{
+        scu_dsp_program_clear();
+        scu_dsp_program_load(&_program[0],
+            sizeof(_program) / sizeof(*_program));
+}
+
+void
+transform_dsp_start(const fix16_t (*matrix)[4], const fix16_vector4_t *vb,
+    uint32_t vb_cnt)
+{
+        assert(vb_cnt > 0);
+        assert(vb_cnt <= TRANSFORM_DSP_VERTEX_CNT_MAX);
+
+        uint32_t matrix_words[TRANSFORM_DSP_MATRIX_WORDS + 1];
+
+        uint32_t row;
+        for (row = 0; row < TRANSFORM_DSP_MATRIX_ROWS; row++) {
+                matrix_words[(row * 4) + 0] = matrix[row][0];
+                matrix_words[(row * 4) + 1] = matrix[row][1];
+                matrix_words[(row * 4) + 2] = matrix[row][2];
+                matrix_words[(row * 4) + 3] = matrix[row][3];
+        }
+
+        /* Used to decrement the batch count */
+        matrix_words[TRANSFORM_DSP_MATRIX_WORDS] = 1;
+
+        _batch_cnt = TRANSFORM_DSP_BATCH_CNT(vb_cnt);
+
+        uint32_t batch_idx;
+        for (batch_idx = 0; batch_idx < _batch_cnt; batch_idx++) {
+                _batch_through(batch_idx)->tdb_z[
+                        TRANSFORM_DSP_BATCH_VERTEX_CNT - 1] =
+                    TRANSFORM_DSP_BATCH_PENDING;
+        }
+
+        /* D0 addresses are in units of longwords */
+        uint32_t params[] = {
+                _batch_cnt,
+                0,
+                (uint32_t)vb >> 2,
+                (uint32_t)&_batches[0] >> 2
+        };
+
+        scu_dsp_data_write(1, 0, matrix_words,
+            sizeof(matrix_words) / sizeof(*matrix_words));
+        scu_dsp_data_write(3, 0, params, sizeof(params) / sizeof(*params));
+
+        scu_dsp_program_pc_set(0);
+        scu_dsp_program_start();
+}
+
+const struct transform_dsp_batch *
+transform_dsp_batch_wait(uint32_t idx)
+{
+        assert(idx < _batch_cnt);
+
+        volatile struct transform_dsp_batch *batch;
+        batch = _batch_through(idx);
+
+        while (batch->tdb_z[TRANSFORM_DSP_BATCH_VERTEX_CNT - 1] ==
+            TRANSFORM_DSP_BATCH_PENDING) {
+        }
+
+        return (const struct transform_dsp_batch *)batch;
+}
+
+void
+transform_dsp_wait(void)
+{
+        scu_dsp_program_end_wait();
+}
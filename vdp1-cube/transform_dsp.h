@@ -0,0 +1,41 @@
+/*
+ * Copyright (c) 2012-2019 Israel Jacquez
+ * See LICENSE for details.
+ *
+ * Israel Jacquez <mrkotfw@gmail.com>
+ */
+
+#ifndef TRANSFORM_DSP_H
+#define TRANSFORM_DSP_H
+
+#include <yaul.h>
+
+/* Vertices are transformed in batches. Vertex buffers must be padded out to a
+ * multiple of TRANSFORM_DSP_BATCH_VERTEX_CNT */
+#define TRANSFORM_DSP_BATCH_VERTEX_CNT  16
+#define TRANSFORM_DSP_VERTEX_CNT_MAX    1024
+
+#define TRANSFORM_DSP_BATCH_CNT(n)                                             \
+    (((n) + (TRANSFORM_DSP_BATCH_VERTEX_CNT - 1)) / TRANSFORM_DSP_BATCH_VERTEX_CNT)
+
+/* Results are planar within each batch: all X, then all Y, then all Z */
+struct transform_dsp_batch {
+        fix16_t tdb_x[TRANSFORM_DSP_BATCH_VERTEX_CNT];
+        fix16_t tdb_y[TRANSFORM_DSP_BATCH_VERTEX_CNT];
+        fix16_t tdb_z[TRANSFORM_DSP_BATCH_VERTEX_CNT];
+} __aligned(16);
+
+extern void transform_dsp_init(void);
+extern void transform_dsp_start(const fix16_t (*)[4], const fix16_vector4_t *,
+    uint32_t);
+
+/* Batches are written back in order. Waiting on each one in turn lets the
+ * results be used while the DSP is still busy with the next ones. The batch
+ * returned is read around the cache */
+extern const struct transform_dsp_batch *transform_dsp_batch_wait(uint32_t);
+
+/* Waits for the transform to end. This has to be called before the next
+ * transform_dsp_start() */
+extern void transform_dsp_wait(void);
+
+#endif /* !TRANSFORM_DSP_H */
@@ -11,14 +11,52 @@
 
 #define MODEL_TRANSFORMATIONS   1 /* 0: No transforms   1: Apply transforms */
 #define MODEL_PROJECT           1 /* 0: Upload          1: Upload and project */
-#define POLYGON_SORT            1 /* 0: No sort         1: Sort */
+#define POLYGON_SORT            0 /* 0: No sort         1: Sort each OT bucket */
 #define RENDER                  1 /* 0: No render       1: Render */
 #define CULLING                 1 /* 0: No culling      1: Culling */
 
+/* Model-view Z of the near plane. Quads entirely in front of it (behind the
+ * camera) are rejected */
+#define CULL_NEAR_Z             F16(-1.0f)
+
+#define TRANSFORM_MODE_CPU      0
+#define TRANSFORM_MODE_DSP      1
+#define TRANSFORM_MODE_COUNT    2
+
+/* The example runs in 320 mode */
+#define FRT_COUNT_1MS           CPU_FRT_NTSC_320_32_COUNT_1MS
+
 static uint16_t colors[TEAPOT_POLYGON_CNT] __unused;
 
-static void model_polygon_project(const fix16_vector4_t *, const uint32_t *,
-    const fix16_vector4_t *, const uint32_t);
+/* Each unique model vertex is transformed once per frame into this cache, and
+ * quads are then assembled from it by index */
+static struct ot_vertex vertex_cache[TEAPOT_VERTEX_CNT];
+
+/* Polygons grouped by the DSP batch holding the last of their vertices, so
+ * each group can be culled as soon as its batch lands. Group N is
+ * [batch_polygon_offsets[N], batch_polygon_offsets[N + 1]) */
+static uint16_t batch_polygons[TEAPOT_POLYGON_CNT];
+static uint16_t batch_polygon_offsets[TRANSFORM_DSP_BATCH_CNT(TEAPOT_VERTEX_CNT) + 1];
+
+/* Number of polygons that survived culling this frame */
+static uint32_t visible_polygon_cnt;
+
+static int32_t transform_mode = TRANSFORM_MODE_CPU;
+
+static const char *transform_mode_names[TRANSFORM_MODE_COUNT] = {
+        "CPU",
+        "DSP"
+};
+
+static smpc_peripheral_digital_t digital;
+
+static void model_matrix_build(fix16_t (*)[4]);
+static void model_polygon_batches_build(const uint32_t *, const uint32_t);
+static void model_vertices_transform(const fix16_vector4_t *, const uint32_t);
+static uint16_t model_vertices_transform_cull(const uint32_t *, const uint32_t);
+static void model_polygon_cull(const uint32_t *, const uint16_t *, const uint32_t);
+static void model_polygon_project(const uint32_t *, const uint32_t);
+static uint32_t frt_us_convert(uint16_t);
 
 static uint32_t tick = 0;
 
@@ -61,8 +99,11 @@ main(void)
                 colors[color_idx] = RGB888_TO_RGB555(color, color, color);
         }
 
+        model_polygon_batches_build(teapot_indices, TEAPOT_POLYGON_CNT);
+
         ot_init();
         matrix_stack_init();
+        transform_dsp_init();
 
         matrix_stack_mode(MATRIX_STACK_MODE_PROJECTION);
 
@@ -99,19 +140,68 @@ main(void)
         while (true) {
                 vdp2_tvmd_vblank_out_wait();
 
+                smpc_peripheral_process();
+                smpc_peripheral_digital_port(1, &digital);
+
+                if ((digital.held.button.a) != 0) {
+                        transform_mode++;
+
+                        if (transform_mode >= TRANSFORM_MODE_COUNT) {
+                                transform_mode = TRANSFORM_MODE_CPU;
+                        }
+                }
+
+                uint16_t frt_transform;
+                uint16_t frt_wait;
+                uint16_t frt_cull;
+
                 // Update
                 matrix_stack_mode(MATRIX_STACK_MODE_MODEL_VIEW);
                 matrix_stack_push(); {
-                        matrix_stack_rotate(angle, 0);
-                        matrix_stack_rotate(angle, 1);
-                        matrix_stack_rotate(angle, 2);
+                        /* The same angle is used about each axis */
+                        fix16_t sin;
+                        sin = fix16_sin(fix16_deg_to_rad(angle));
+                        fix16_t cos;
+                        cos = fix16_cos(fix16_deg_to_rad(angle));
+
+                        matrix_stack_rotate_sin_cos(sin, cos,
+                            MATRIX_STACK_AXIS_X);
+                        matrix_stack_rotate_sin_cos(sin, cos,
+                            MATRIX_STACK_AXIS_Y);
+                        matrix_stack_rotate_sin_cos(sin, cos,
+                            MATRIX_STACK_AXIS_Z);
 
                         angle = fix16_add(angle, F16(-1.0f));
 
-                        model_polygon_project(teapot_vertices, teapot_indices,
-                            teapot_normals, TEAPOT_POLYGON_CNT);
+                        cpu_frt_count_set(0);
+
+                        model_vertices_transform(teapot_vertices,
+                            TEAPOT_VERTEX_CNT);
+                        frt_transform = cpu_frt_count_get();
+
+                        /* With the DSP, only the time spent waiting on it
+                         * isn't overlapped with culling */
+                        frt_wait = model_vertices_transform_cull(
+                                teapot_indices, TEAPOT_VERTEX_CNT);
+                        frt_cull = cpu_frt_count_get() - frt_transform - frt_wait;
                 } matrix_stack_pop();
 
+                const uint32_t transform_us = frt_us_convert(frt_transform);
+                const uint32_t wait_us = frt_us_convert(frt_wait);
+                const uint32_t cull_us = frt_us_convert(frt_cull);
+
+                dbgio_printf("\x1b[H\x1b[2J"
+                             "Transform: %s (A to switch)\n"
+                             "visible   %3lu/%d\n"
+                             "transform %3lu.%03lums\n"
+                             "wait      %3lu.%03lums\n"
+                             "cull      %3lu.%03lums\n",
+                             transform_mode_names[transform_mode],
+                             visible_polygon_cnt, TEAPOT_POLYGON_CNT,
+                             transform_us / 1000, transform_us % 1000,
+                             wait_us / 1000, wait_us % 1000,
+                             cull_us / 1000, cull_us % 1000);
+
                 vdp1_cmdt_list_begin(1); {
                         int32_t idx;
                         for (idx = OT_PRIMITIVE_BUCKETS - 1; idx >= 0; idx--) {
@@ -122,12 +212,12 @@ main(void)
 
 #if POLYGON_SORT == 1
                                 ot_bucket_primitive_sort(idx & (OT_PRIMITIVE_BUCKETS - 1),
-                                    OT_PRIMITIVE_BUCKET_SORT_INSERTION);
+                                    OT_PRIMITIVE_BUCKET_SORT_RADIX);
 #endif
 
 #if RENDER == 1
                                 struct ot_primitive *otp;
-                                TAILQ_FOREACH (otp, ot_bucket(idx), otp_entries) {
+                                SLIST_FOREACH (otp, ot_bucket(idx), otp_entries) {
                                         polygon.color = otp->otp_color;
                                         polygon.draw_mode.transparent_pixel = true;
                                         polygon.draw_mode.end_code = true;
@@ -152,6 +242,8 @@ main(void)
 
                 vdp2_tvmd_vblank_in_wait();
 
+                dbgio_flush();
+
                 // Draw
                 vdp1_cmdt_list_commit();
         }
@@ -170,6 +262,12 @@ hardware_init(void)
         smpc_init();
         smpc_peripheral_init();
 
+        cpu_frt_init(CPU_FRT_CLOCK_DIV_32);
+
+        dbgio_dev_default_init(DBGIO_DEV_VDP2_ASYNC);
+        dbgio_dev_font_load();
+        dbgio_dev_font_load_wait();
+
         /* Disable interrupts */
         cpu_intc_disable();
 
@@ -205,79 +303,273 @@ vblank_out_handler(irq_mux_handle_t *irq_mux __unused)
         if ((vdp2_tvmd_vcount_get()) == 0) {
                 tick = (tick & 0xFFFFFFFF) + 1;
         }
+
+        smpc_peripheral_intback_issue();
 }
 
-static void __unused
-model_polygon_project(const fix16_vector4_t *vb, const uint32_t *ib,
-    const fix16_vector4_t *nb, const uint32_t ib_cnt)
+static inline fix16_t __always_inline
+matrix_row_dot(const fix16_t *row, const fix16_vector4_t *v)
 {
-        fix16_vector4_t vertex_mv[4];
-        fix16_vector4_t vertex_projected[4];
+        /* Model vertices always have w = 1 */
+        return fix16_add(fix16_add(fix16_mul(row[0], v->x),
+                fix16_mul(row[1], v->y)),
+            fix16_add(fix16_mul(row[2], v->z), row[3]));
+}
 
+static inline void __always_inline
+vertex_clip(struct ot_vertex *otv)
+{
+        uint8_t clip;
+        clip = 0;
+
+        /* Screen coordinates are relative to the center of the screen */
+        if (otv->otv_coord.x < -(SCREEN_WIDTH / 2)) {
+                clip |= OT_VERTEX_CLIP_LEFT;
+        } else if (otv->otv_coord.x > ((SCREEN_WIDTH / 2) - 1)) {
+                clip |= OT_VERTEX_CLIP_RIGHT;
+        }
+
+        if (otv->otv_coord.y < -(SCREEN_HEIGHT / 2)) {
+                clip |= OT_VERTEX_CLIP_TOP;
+        } else if (otv->otv_coord.y > ((SCREEN_HEIGHT / 2) - 1)) {
+                clip |= OT_VERTEX_CLIP_BOTTOM;
+        }
+
+        if (otv->otv_z > CULL_NEAR_Z) {
+                clip |= OT_VERTEX_CLIP_NEAR;
+        }
+
+        otv->otv_clip = clip;
+}
+
+static void
+model_matrix_build(fix16_t (*matrix)[4])
+{
         fix16_matrix4_t *matrix_projection;
         matrix_projection = matrix_stack_top(
-                MATRIX_STACK_MODE_PROJECTION)->ms_matrix;
+                MATRIX_STACK_MODE_PROJECTION);
 
         fix16_matrix4_t *matrix_model_view;
         matrix_model_view = matrix_stack_top(
-                MATRIX_STACK_MODE_MODEL_VIEW)->ms_matrix;
+                MATRIX_STACK_MODE_MODEL_VIEW);
+
+        /* Concatenate once per frame: S(P(VM)), where S scales to screen
+         * coordinates */
+        fix16_matrix4_t matrix_pmv;
+        fix16_matrix4_multiply(matrix_projection, matrix_model_view,
+            &matrix_pmv);
+
+        fix16_t half_width;
+        half_width = F16((float)SCREEN_WIDTH / 2.0f);
+
+        fix16_t half_height;
+        half_height = F16((float)-SCREEN_HEIGHT / 2.0f);
+
+        /* The projection is orthographic, so there is no divide by W. Only
+         * the Z row of the model-view matrix is needed for depth */
+        uint32_t col;
+        for (col = 0; col < 4; col++) {
+                matrix[0][col] = fix16_mul(matrix_pmv.frow[0][col], half_width);
+                matrix[1][col] = fix16_mul(matrix_pmv.frow[1][col], half_height);
+                matrix[2][col] = matrix_model_view->frow[2][col];
+        }
+}
+
+static void
+model_polygon_batches_build(const uint32_t *ib, const uint32_t ib_cnt)
+{
+        uint16_t polygon_batches[TEAPOT_POLYGON_CNT];
+
+        uint32_t polygon_idx;
+        for (polygon_idx = 0; polygon_idx < ib_cnt; polygon_idx++) {
+                const uint32_t idx = polygon_idx * 4;
+
+                uint32_t vertex_idx_max;
+                vertex_idx_max = ib[idx];
+
+                uint32_t vertex;
+                for (vertex = 1; vertex < 4; vertex++) {
+                        if (ib[idx + vertex] > vertex_idx_max) {
+                                vertex_idx_max = ib[idx + vertex];
+                        }
+                }
+
+                polygon_batches[polygon_idx] =
+                    vertex_idx_max / TRANSFORM_DSP_BATCH_VERTEX_CNT;
+                batch_polygon_offsets[polygon_batches[polygon_idx] + 1]++;
+        }
+
+        uint32_t batch_idx;
+        for (batch_idx = 1;
+             batch_idx <= TRANSFORM_DSP_BATCH_CNT(TEAPOT_VERTEX_CNT);
+             batch_idx++) {
+                batch_polygon_offsets[batch_idx] +=
+                    batch_polygon_offsets[batch_idx - 1];
+        }
+
+        /* Counting sort, stable so that polygons keep their relative order */
+        uint16_t offsets[TRANSFORM_DSP_BATCH_CNT(TEAPOT_VERTEX_CNT)];
+        memcpy(offsets, batch_polygon_offsets, sizeof(offsets));
+
+        for (polygon_idx = 0; polygon_idx < ib_cnt; polygon_idx++) {
+                uint16_t *offset;
+                offset = &offsets[polygon_batches[polygon_idx]];
 
-        /* PVMv = (P(VM))v */
+                batch_polygons[*offset] = polygon_idx;
+                (*offset)++;
+        }
+}
 
-        /* Calculate world to object space matrix (inverse) */
-        fix16_matrix4_t matrix_wo;
-        fix16_matrix4_inverse(matrix_model_view, &matrix_wo);
+static void
+model_vertices_transform(const fix16_vector4_t *vb, const uint32_t vb_cnt)
+{
+        assert(vb_cnt <= TEAPOT_VERTEX_CNT);
 
-        fix16_vector4_t view_forward;
-        view_forward.x = F16(0.0f);
-        view_forward.y = F16(0.0f);
-        view_forward.z = F16(-1.0f);
-        view_forward.w = F16(1.0f);
+        fix16_t matrix[3][4];
+        model_matrix_build(matrix);
 
-        fix16_vector4_t view_forward_object;
-        fix16_vector4_matrix4_multiply(&matrix_wo, &view_forward,
-            &view_forward_object);
+        if (transform_mode == TRANSFORM_MODE_DSP) {
+                transform_dsp_start(matrix, vb, vb_cnt);
+
+                return;
+        }
 
         uint32_t idx;
-        for (idx = 0; idx < (ib_cnt * 4); idx += 4) {
-                uint16_t color;
-                color = colors[idx >> 2];
+        for (idx = 0; idx < vb_cnt; idx++) {
+                const fix16_vector4_t *vtx;
+                vtx = &vb[idx];
+
+                struct ot_vertex *otv;
+                otv = &vertex_cache[idx];
+
+                otv->otv_coord.x = fix16_to_int(matrix_row_dot(matrix[0], vtx));
+                otv->otv_coord.y = fix16_to_int(matrix_row_dot(matrix[1], vtx));
+                otv->otv_z = matrix_row_dot(matrix[2], vtx);
+
+                vertex_clip(otv);
+        }
+}
+
+static uint16_t
+model_vertices_transform_cull(const uint32_t *ib, const uint32_t vb_cnt)
+{
+        visible_polygon_cnt = 0;
+
+        if (transform_mode != TRANSFORM_MODE_DSP) {
+                model_polygon_cull(ib, batch_polygons, TEAPOT_POLYGON_CNT);
+
+                return 0;
+        }
+
+        uint16_t frt_wait;
+        frt_wait = 0;
+
+        /* Cull the polygons of each batch as soon as it lands, while the DSP
+         * transforms the next ones */
+        uint32_t batch_idx;
+        for (batch_idx = 0; batch_idx < TRANSFORM_DSP_BATCH_CNT(vb_cnt); batch_idx++) {
+                const uint16_t frt_begin = cpu_frt_count_get();
+
+                const struct transform_dsp_batch *batch;
+                batch = transform_dsp_batch_wait(batch_idx);
 
-                const fix16_vector4_t *vtx[4];
+                frt_wait += cpu_frt_count_get() - frt_begin;
 
-                /* Submit each vertex in this order: A, B, C, D */
-                /* Vertex A */ vtx[0] = &vb[ib[idx]];
-                /* Vertex B */ vtx[1] = &vb[ib[idx + 1]];
-                /* Vertex C */ vtx[2] = &vb[ib[idx + 2]];
-                /* Vertex D */ vtx[3] = &vb[ib[idx + 3]];
+                const uint32_t first = batch_idx * TRANSFORM_DSP_BATCH_VERTEX_CNT;
+
+                uint32_t idx;
+                for (idx = first;
+                     (idx < vb_cnt) && (idx < (first + TRANSFORM_DSP_BATCH_VERTEX_CNT));
+                     idx++) {
+                        const uint32_t batch_vertex_idx = idx - first;
+
+                        struct ot_vertex *otv;
+                        otv = &vertex_cache[idx];
+
+                        otv->otv_coord.x = fix16_to_int(batch->tdb_x[batch_vertex_idx]);
+                        otv->otv_coord.y = fix16_to_int(batch->tdb_y[batch_vertex_idx]);
+                        otv->otv_z = batch->tdb_z[batch_vertex_idx];
+
+                        vertex_clip(otv);
+                }
+
+                const uint32_t offset = batch_polygon_offsets[batch_idx];
+
+                model_polygon_cull(ib, &batch_polygons[offset],
+                    batch_polygon_offsets[batch_idx + 1] - offset);
+        }
+
+        transform_dsp_wait();
+
+        return frt_wait;
+}
+
+static void
+model_polygon_cull(const uint32_t *ib, const uint16_t *polygons,
+    const uint32_t polygon_cnt)
+{
+        uint32_t polygons_idx;
+        for (polygons_idx = 0; polygons_idx < polygon_cnt; polygons_idx++) {
+                const uint32_t polygon_idx = polygons[polygons_idx];
+                const uint32_t idx = polygon_idx * 4;
 
 #if CULLING == 1
-                /* Face culling */
-                fix16_t dot;
-                dot = fix16_vector4_dot(&nb[idx >> 2], &view_forward_object);
-                if (dot < F16(0.0f)) {
+                const struct ot_vertex *a;
+                a = &vertex_cache[ib[idx]];
+                const struct ot_vertex *b;
+                b = &vertex_cache[ib[idx + 1]];
+                const struct ot_vertex *c;
+                c = &vertex_cache[ib[idx + 2]];
+                const struct ot_vertex *d;
+                d = &vertex_cache[ib[idx + 3]];
+
+                /* Trivially reject quads that lie entirely outside of one of
+                 * the clip planes */
+                if ((a->otv_clip & b->otv_clip & c->otv_clip & d->otv_clip) != 0) {
+                        continue;
+                }
+
+                /* Back face culling. The signed area of the quad is the cross
+                 * product of its diagonals. As Y is flipped in screen space,
+                 * front faces have a negative area */
+                int32_t area;
+                area = ((c->otv_coord.x - a->otv_coord.x) *
+                        (d->otv_coord.y - b->otv_coord.y)) -
+                       ((c->otv_coord.y - a->otv_coord.y) *
+                        (d->otv_coord.x - b->otv_coord.x));
+
+                if (area >= 0) {
                         continue;
                 }
 #endif
 
-                fix16_vector4_matrix4_multiply(matrix_model_view, vtx[0],
-                    &vertex_mv[0]);
-                fix16_vector4_matrix4_multiply(matrix_model_view, vtx[1],
-                    &vertex_mv[1]);
-                fix16_vector4_matrix4_multiply(matrix_model_view, vtx[2],
-                    &vertex_mv[2]);
-                fix16_vector4_matrix4_multiply(matrix_model_view, vtx[3],
-                    &vertex_mv[3]);
-
-                fix16_vector4_matrix4_multiply(matrix_projection, &vertex_mv[0],
-                    &vertex_projected[0]);
-                fix16_vector4_matrix4_multiply(matrix_projection, &vertex_mv[1],
-                    &vertex_projected[1]);
-                fix16_vector4_matrix4_multiply(matrix_projection, &vertex_mv[2],
-                    &vertex_projected[2]);
-                fix16_vector4_matrix4_multiply(matrix_projection, &vertex_mv[3],
-                    &vertex_projected[3]);
-
-                ot_primitive_add(vertex_mv, vertex_projected, color);
+                model_polygon_project(ib, polygon_idx);
+
+                visible_polygon_cnt++;
         }
 }
+
+static void
+model_polygon_project(const uint32_t *ib, const uint32_t polygon_idx)
+{
+        const uint32_t idx = polygon_idx * 4;
+
+        uint16_t color;
+        color = colors[polygon_idx];
+
+        const struct ot_vertex *otv[4];
+
+        /* Submit each vertex in this order: A, B, C, D */
+        /* Vertex A */ otv[0] = &vertex_cache[ib[idx]];
+        /* Vertex B */ otv[1] = &vertex_cache[ib[idx + 1]];
+        /* Vertex C */ otv[2] = &vertex_cache[ib[idx + 2]];
+        /* Vertex D */ otv[3] = &vertex_cache[ib[idx + 3]];
+
+        ot_primitive_add(otv, color);
+}
+
+static uint32_t
+frt_us_convert(uint16_t ticks)
+{
+        return ((uint32_t)ticks * 1000) / FRT_COUNT_1MS;
+}
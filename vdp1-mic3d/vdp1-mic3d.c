@@ -12,6 +12,11 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+#include "radix_sort.h"
+
+#define SORT_BENCHMARK          0 /* 0: Spin the model   1: Benchmark the depth sorts */
+#define ROTATE_BENCHMARK        0 /* 0: Spin the model   1: Benchmark the rotation kernels */
+
 #define SCREEN_WIDTH    320
 #define SCREEN_HEIGHT   224
 
@@ -26,6 +31,19 @@
 #define INT2FIX(a) (((int32_t)(a))<<10)
 #define FIX2INT(a) (((int32_t)(a))>>10)
 
+/* The summed Z of a quad stays well within 19 bits, so dropping 4 bits leaves
+ * a signed 16-bit depth that is then biased for the radix sort */
+#define SORT_DEPTH_SHIFT        4
+#define SORT_DEPTH_BIAS         0x8000
+
+/* The perspective divide is replaced by a multiply with a scale factor looked
+ * up by the integer part of the view space Z. The scale has 12 fractional
+ * bits, so with the model's extents the product stays within 32 bits, and
+ * the result is within a pixel of the divide */
+#define PROJECT_Z_MIN           (-128)
+#define PROJECT_Z_MAX           127
+#define PROJECT_SCALE_SHIFT     12
+
 typedef struct {
         int32_t x;
         int32_t y;
@@ -39,6 +57,25 @@ typedef struct {
         int32_t p3;
 } __packed quad;
 
+/* Rotation matrix, in the same fixed point as the sine table */
+typedef struct {
+        int32_t m[3][3];
+} __aligned(4) matrix;
+
+typedef struct {
+        const point *points;
+        const quad *faces;
+        uint32_t point_count;
+        uint32_t face_count;
+        /* Translation, in model units */
+        point translation;
+
+        /* Where the object's points and faces start in the scene's
+         * buffers. Set by _scene_init() */
+        uint32_t point_offset;
+        uint32_t face_offset;
+} object;
+
 static void _hardware_init(void);
 
 static uint8_t _sintb_buffer[] __aligned(4) = {
@@ -196,7 +233,7 @@ static int32_t *_sintb = (int32_t *)&_sintb_buffer[0];
 #define MODEL_POINT_COUNT       (ELEMENT_COUNT(_points_m) + ELEMENT_COUNT(_points_i) + ELEMENT_COUNT(_points_c))
 #define MODEL_FACE_COUNT        (ELEMENT_COUNT(_face_m) + ELEMENT_COUNT(_face_i) + ELEMENT_COUNT(_face_c))
 
-static point _points_m[28] = {
+static const point _points_m[28] = {
         {-5, -3, -2},
         {-3, -3, -2},
         { 3, -3, -2},
@@ -228,7 +265,7 @@ static point _points_m[28] = {
         {-5,  3,  2}
 };
 
-static point _points_i[10] = {
+static const point _points_i[10] = {
         {-1, -3, -2},
         { 1, -1, -2},
         { 1,  3, -2},
@@ -242,7 +279,7 @@ static point _points_i[10] = {
         {-1, -1,  2}
 };
 
-static point _points_c[22] = {
+static const point _points_c[22] = {
         {-3, -3, -2},
         { 1, -3, -2},
         { 3, -1, -2},
@@ -268,7 +305,7 @@ static point _points_c[22] = {
         {-3, -1,  2}
 };
 
-static quad _face_m[23] = {
+static const quad _face_m[23] = {
         { 0,  1, 12, 13},
         { 1,  2,  6, 11},
         { 6,  3,  4,  5},
@@ -294,7 +331,7 @@ static quad _face_m[23] = {
         { 2, 16, 17,  3}
 };
 
-static quad _face_i[8] = {
+static const quad _face_i[8] = {
         { 0,  1,  4,  4},
         { 1,  2,  3,  4},
         { 0,  5,  6,  1},
@@ -305,7 +342,7 @@ static quad _face_i[8] = {
         { 6,  7,  8,  9}
 };
 
-static quad _face_c[16] = {
+static const quad _face_c[16] = {
         { 0,  1,  3, 10},
         { 1,  2,  3,  3},
         {10,  4,  8,  9},
@@ -324,28 +361,83 @@ static quad _face_c[16] = {
         {11,  0,  9, 20}
 };
 
-static point _rotated_m[ELEMENT_COUNT(_points_m)];
-static point _projected_m[ELEMENT_COUNT(_points_m)];
+#define OBJECT(_points, _faces, _x, _y, _z)                                    \
+{                                                                              \
+        .points = _points,                                                     \
+        .faces = _faces,                                                       \
+        .point_count = ELEMENT_COUNT(_points),                                 \
+        .face_count = ELEMENT_COUNT(_faces),                                   \
+        .translation = {                                                       \
+                .x = _x,                                                       \
+                .y = _y,                                                       \
+                .z = _z                                                        \
+        }                                                                      \
+}
 
-static point _rotated_i[ELEMENT_COUNT(_points_i)];
-static point _projected_i[ELEMENT_COUNT(_points_i)];
+static object _objects[] = {
+        OBJECT(_points_m, _face_m, -50, 0, 0),
+        OBJECT(_points_i, _face_i,   0, 0, 0),
+        OBJECT(_points_c, _face_c,  35, 0, 0)
+};
 
-static point _rotated_c[ELEMENT_COUNT(_points_c)];
-static point _projected_c[ELEMENT_COUNT(_points_c)];
+/* The points of every object, in model space and once projected, and the
+ * faces of every object, indexing into those buffers */
+static point _scene_points[MODEL_POINT_COUNT];
+static point _projected_points[MODEL_POINT_COUNT];
+static quad _faces[MODEL_FACE_COUNT];
 
 /* Allow max 64 faces to be sorted */
 static int32_t _avg_z[64];
 
-static quad _faces[MODEL_FACE_COUNT];
-static point _all_points[MODEL_POINT_COUNT];
 static int32_t _face_order[MODEL_FACE_COUNT];
+static radix_sort_pair_t _sort_pairs[MODEL_FACE_COUNT];
 
 static point _camera;
 
-static void _rotate(point *, point *, int32_t, int32_t);
-static void _transform(point *, point *, int32_t, int32_t, int32_t, int32_t);
-static void _project(point *, point *, int32_t);
+static int32_t _project_scale[PROJECT_Z_MAX - PROJECT_Z_MIN + 1];
+
+static void _scene_init(void);
+static void _project_init(void);
+static void _matrix_rotation_set(matrix *, int32_t, int32_t, int32_t);
+static void _rotate_transform_project(const point *, point *, const matrix *,
+    int32_t, int32_t, int32_t, int32_t);
 static void _sort_quads(quad *, point *, int32_t *, int32_t);
+static void _bubble_sort(int32_t *, int32_t *, int32_t);
+
+#if SORT_BENCHMARK == 1
+#define BENCHMARK_FACE_COUNT_MAX        2000
+
+static const int32_t _benchmark_face_counts[] = {
+        47,
+        500,
+        BENCHMARK_FACE_COUNT_MAX
+};
+
+static int32_t _benchmark_z[BENCHMARK_FACE_COUNT_MAX];
+static int32_t _benchmark_avg_z[BENCHMARK_FACE_COUNT_MAX];
+static int32_t _benchmark_order[BENCHMARK_FACE_COUNT_MAX];
+static radix_sort_pair_t _benchmark_pairs[BENCHMARK_FACE_COUNT_MAX];
+
+static void _sort_benchmark(void) __noreturn;
+#endif /* SORT_BENCHMARK */
+
+#if ROTATE_BENCHMARK == 1
+#define BENCHMARK_ROTATE_PASS_COUNT     100
+
+static point _benchmark_points[MODEL_POINT_COUNT];
+
+static void _rotate_benchmark(void) __noreturn;
+#endif /* ROTATE_BENCHMARK */
+
+#if (SORT_BENCHMARK == 1) || (ROTATE_BENCHMARK == 1)
+static volatile uint32_t _frt_ovi_count = 0;
+
+static void _benchmark_init(void);
+static uint32_t _benchmark_ticks_get(void);
+static void _benchmark_ticks_reset(void);
+static uint32_t _benchmark_ticks_us_convert(uint32_t);
+static void _frt_ovi_handler(void);
+#endif /* SORT_BENCHMARK || ROTATE_BENCHMARK */
 
 void
 main(void)
@@ -359,6 +451,10 @@ main(void)
 
         _hardware_init();
 
+#if SORT_BENCHMARK == 1
+        _sort_benchmark();
+#endif /* SORT_BENCHMARK */
+
         vdp1_cmdt_list_t *cmdt_list;
         cmdt_list = vdp1_cmdt_list_alloc(ORDER_COUNT);
 
@@ -379,84 +475,44 @@ main(void)
         uint32_t j;
         uint32_t k;
 
-        for (i = 0; i < ELEMENT_COUNT(_points_m); i++) {
-                _points_m[i].x = INT2FIX(_points_m[i].x * 6);
-                _points_m[i].y = INT2FIX(_points_m[i].y * 6);
-                _points_m[i].z = INT2FIX(_points_m[i].z * 6);
-        }
-
-        for (i = 0; i < ELEMENT_COUNT(_points_i); i++) {
-                _points_i[i].x = INT2FIX(_points_i[i].x * 6);
-                _points_i[i].y = INT2FIX(_points_i[i].y * 6);
-                _points_i[i].z = INT2FIX(_points_i[i].z * 6);
-        }
-
-        for (i = 0; i < ELEMENT_COUNT(_points_c); i++) {
-                _points_c[i].x = INT2FIX(_points_c[i].x * 6);
-                _points_c[i].y = INT2FIX(_points_c[i].y * 6);
-                _points_c[i].z = INT2FIX(_points_c[i].z * 6);
-        }
-
-        j = 0;
-
-        for (i = 0; i < ELEMENT_COUNT(_face_m); i++, j++) {
-                _faces[j].p0 = _face_m[i].p0;
-                _faces[j].p1 = _face_m[i].p1;
-                _faces[j].p2 = _face_m[i].p2;
-                _faces[j].p3 = _face_m[i].p3;
-        }
-
-        for (i = 0; i < ELEMENT_COUNT(_face_i); i++, j++) {
-                _faces[j].p0 = _face_i[i].p0 + 28;
-                _faces[j].p1 = _face_i[i].p1 + 28;
-                _faces[j].p2 = _face_i[i].p2 + 28;
-                _faces[j].p3 = _face_i[i].p3 + 28;
-        }
-
-        for (i = 0; i < ELEMENT_COUNT(_face_c); i++, j++) {
-                _faces[j].p0 = _face_c[i].p0 + 38;
-                _faces[j].p1 = _face_c[i].p1 + 38;
-                _faces[j].p2 = _face_c[i].p2 + 38;
-                _faces[j].p3 = _face_c[i].p3 + 38;
-        }
+        _scene_init();
 
         _camera.x = 160;
         _camera.y = 112;
         _camera.z = -200;
 
-        int32_t theta = 0;
-
-        while (true) {
-                vdp1_sync_cmdt_list_put(cmdt_list, NULL, NULL);
+        _project_init();
 
-                _rotate(_points_m, _rotated_m, theta, 28);
-                _rotate(_points_i, _rotated_i, theta, 10);
-                _rotate(_points_c, _rotated_c, theta, 22);
+#if ROTATE_BENCHMARK == 1
+        _rotate_benchmark();
+#endif /* ROTATE_BENCHMARK */
 
-                theta++;
+        int32_t theta = 0;
 
-                _transform(_rotated_m, _rotated_m, -50, 0, 0, 28);
-                _transform(_rotated_c, _rotated_c, 35, 0, 0, 22);
+        matrix rotation;
 
-                _project(_rotated_m, _projected_m, 28);
-                _project(_rotated_i, _projected_i, 10);
-                _project(_rotated_c, _projected_c, 22);
+        while (true) {
+                vdp1_sync_cmdt_list_put(cmdt_list, NULL, NULL);
 
-                j = 0;
+                /* All objects share the same rotation */
+                _matrix_rotation_set(&rotation, theta, theta, theta);
 
-                for (i = 0; i < ELEMENT_COUNT(_projected_m); i++, j++) {
-                        _all_points[j] = _projected_m[i];
-                }
+                for (i = 0; i < ELEMENT_COUNT(_objects); i++) {
+                        const object * const obj = &_objects[i];
 
-                for (i = 0; i < ELEMENT_COUNT(_projected_i); i++, j++) {
-                        _all_points[j] = _projected_i[i];
+                        _rotate_transform_project(
+                                &_scene_points[obj->point_offset],
+                                &_projected_points[obj->point_offset],
+                                &rotation,
+                                obj->translation.x,
+                                obj->translation.y,
+                                obj->translation.z,
+                                obj->point_count);
                 }
 
-                for (i = 0; i < ELEMENT_COUNT(_projected_c); i++, j++) {
-                        _all_points[j] = _projected_c[i];
-                }
+                theta++;
 
-                _sort_quads(_faces, _all_points, _face_order, MODEL_FACE_COUNT);
+                _sort_quads(_faces, _projected_points, _face_order, MODEL_FACE_COUNT);
 
                 for (i = 0; i < 47; i++) {
                         j = _face_order[i];
@@ -486,17 +542,17 @@ main(void)
                         /* Set the vertices directly as we have to cast from
                          * int32_t to int16_t */
 
-                        cmdt->cmd_xa = _all_points[_faces[j].p0].x;
-                        cmdt->cmd_ya = _all_points[_faces[j].p0].y;
+                        cmdt->cmd_xa = _projected_points[_faces[j].p0].x;
+                        cmdt->cmd_ya = _projected_points[_faces[j].p0].y;
 
-                        cmdt->cmd_xb = _all_points[_faces[j].p3].x;
-                        cmdt->cmd_yb = _all_points[_faces[j].p3].y;
+                        cmdt->cmd_xb = _projected_points[_faces[j].p3].x;
+                        cmdt->cmd_yb = _projected_points[_faces[j].p3].y;
 
-                        cmdt->cmd_xc = _all_points[_faces[j].p2].x;
-                        cmdt->cmd_yc = _all_points[_faces[j].p2].y;
+                        cmdt->cmd_xc = _projected_points[_faces[j].p2].x;
+                        cmdt->cmd_yc = _projected_points[_faces[j].p2].y;
 
-                        cmdt->cmd_xd = _all_points[_faces[j].p1].x;
-                        cmdt->cmd_yd = _all_points[_faces[j].p1].y;
+                        cmdt->cmd_xd = _projected_points[_faces[j].p1].x;
+                        cmdt->cmd_yd = _projected_points[_faces[j].p1].y;
 
                         vdp1_cmdt_polygon_set(cmdt);
                         vdp1_cmdt_param_draw_mode_set(cmdt, draw_mode);
@@ -513,41 +569,145 @@ main(void)
         }
 }
 
-static void
-_rotate(point *in, point *out, int32_t angle, int32_t n)
+/* Rotation about X, then Y, then Z, all by the same angle. Kept to compare
+ * against the matrix kernel */
+static inline void __always_inline __unused
+_rotate_point(const point *in, point *out, int32_t san, int32_t can)
 {
-        int32_t i;
+        int32_t x;
+        int32_t y;
+        int32_t z;
         int32_t temp;
-        int32_t can, san;
 
-        san = _sintb[angle & 0xff];
-        can = _sintb[(angle + 0x40) & 0xff];
+        /* About X */
+        y = FIX2INT((in->y * can) - (in->z * san));
+        z = FIX2INT((in->y * san) + (in->z * can));
 
-        for (i = 0; i < n; i++) {
-                /* About X */
-                out[i].y = ((in[i].y * can) - (in[i].z * san));
-                out[i].y = FIX2INT(out[i].y);
-                out[i].z = ((in[i].y * san) + (in[i].z * can));
-                out[i].z = FIX2INT(out[i].z);
-
-                /* About Y */
-                out[i].x = ((in[i].x * can) - (out[i].z * san));
-                out[i].x = FIX2INT(out[i].x);
-                out[i].z = ((in[i].x * san) + (out[i].z * can));
-                out[i].z = FIX2INT(out[i].z);
-
-                /* About Z */
-                temp = out[i].x;
-                out[i].x = ((out[i].x * can) - (out[i].y * san));
-                out[i].x = FIX2INT(out[i].x);
-                out[i].y = ((temp * san) + (out[i].y * can));
-                out[i].y = FIX2INT(out[i].y);
+        /* About Y */
+        x = FIX2INT((in->x * can) - (z * san));
+        z = FIX2INT((in->x * san) + (z * can));
+
+        /* About Z */
+        temp = x;
+        x = FIX2INT((x * can) - (y * san));
+        y = FIX2INT((temp * san) + (y * can));
+
+        out->x = x;
+        out->y = y;
+        out->z = z;
+}
+
+static void
+_scene_init(void)
+{
+        uint32_t point_offset;
+        uint32_t face_offset;
+        uint32_t i;
+        uint32_t j;
+
+        point_offset = 0;
+        face_offset = 0;
+
+        for (i = 0; i < ELEMENT_COUNT(_objects); i++) {
+                object * const obj = &_objects[i];
+
+                obj->point_offset = point_offset;
+                obj->face_offset = face_offset;
+
+                for (j = 0; j < obj->point_count; j++) {
+                        point * const p = &_scene_points[point_offset + j];
+
+                        p->x = INT2FIX(obj->points[j].x * 6);
+                        p->y = INT2FIX(obj->points[j].y * 6);
+                        p->z = INT2FIX(obj->points[j].z * 6);
+                }
+
+                /* Rebase the face indices into the scene's point buffer */
+                for (j = 0; j < obj->face_count; j++) {
+                        quad * const f = &_faces[face_offset + j];
+
+                        f->p0 = obj->faces[j].p0 + point_offset;
+                        f->p1 = obj->faces[j].p1 + point_offset;
+                        f->p2 = obj->faces[j].p2 + point_offset;
+                        f->p3 = obj->faces[j].p3 + point_offset;
+                }
+
+                point_offset += obj->point_count;
+                face_offset += obj->face_count;
         }
+}
+
+/* Builds Rz * Ry * Rx, the same rotation _rotate_point() applies, but with an
+ * angle per axis */
+static void
+_matrix_rotation_set(matrix *matrix, int32_t angle_x, int32_t angle_y,
+    int32_t angle_z)
+{
+        const int32_t sx = _sintb[angle_x & 0xff];
+        const int32_t cx = _sintb[(angle_x + 0x40) & 0xff];
+        const int32_t sy = _sintb[angle_y & 0xff];
+        const int32_t cy = _sintb[(angle_y + 0x40) & 0xff];
+        const int32_t sz = _sintb[angle_z & 0xff];
+        const int32_t cz = _sintb[(angle_z + 0x40) & 0xff];
+
+        const int32_t sysx = FIX2INT(sy * sx);
+        const int32_t sycx = FIX2INT(sy * cx);
+
+        matrix->m[0][0] = FIX2INT(cz * cy);
+        matrix->m[0][1] = FIX2INT(-(cz * sysx) - (sz * cx));
+        matrix->m[0][2] = FIX2INT(-(cz * sycx) + (sz * sx));
+
+        matrix->m[1][0] = FIX2INT(sz * cy);
+        matrix->m[1][1] = FIX2INT(-(sz * sysx) + (cz * cx));
+        matrix->m[1][2] = FIX2INT(-(sz * sycx) - (cz * sx));
+
+        matrix->m[2][0] = sy;
+        matrix->m[2][1] = FIX2INT(cy * sx);
+        matrix->m[2][2] = FIX2INT(cy * cx);
+}
+
+/* Dot product of a matrix row and a point with three MAC.L. The sum fits in
+ * 32 bits, so only MACL is needed */
+static inline int32_t __always_inline
+_matrix_row_dot(const int32_t *row, const point *p)
+{
+        const int32_t *v = &p->x;
+        int32_t result;
+
+        __asm__ volatile ("clrmac\n"
+                          "mac.l @%1+, @%2+\n"
+                          "mac.l @%1+, @%2+\n"
+                          "mac.l @%1+, @%2+\n"
+                          "sts macl, %0\n"
+            : "=r" (result), "+r" (row), "+r" (v)
+            :
+            : "mach", "macl", "memory");
+
+        return FIX2INT(result);
+}
 
+static inline void __always_inline
+_matrix_point_mul(const matrix *matrix, const point *in, point *out)
+{
+        out->x = _matrix_row_dot(matrix->m[0], in);
+        out->y = _matrix_row_dot(matrix->m[1], in);
+        out->z = _matrix_row_dot(matrix->m[2], in);
 }
 
 static void
-_transform(point *in, point *out, int32_t xt, int32_t yt, int32_t zt, int32_t n)
+_project_init(void)
+{
+        int32_t z;
+
+        for (z = PROJECT_Z_MIN; z <= PROJECT_Z_MAX; z++) {
+                _project_scale[z - PROJECT_Z_MIN] =
+                    (_camera.z << PROJECT_SCALE_SHIFT) / (_camera.z - z);
+        }
+}
+
+static void
+_rotate_transform_project(const point *in, point *out, const matrix *matrix,
+    int32_t xt, int32_t yt, int32_t zt, int32_t n)
 {
         int32_t i;
 
@@ -556,48 +716,80 @@ _transform(point *in, point *out, int32_t xt, int32_t yt, int32_t zt, int32_t n)
         zt = INT2FIX(zt);
 
         for (i = 0; i < n; i++) {
-                out[i].x = in[i].x + xt;
-                out[i].y = in[i].y + yt;
-                out[i].z = in[i].z + zt;
+                point rotated;
+
+                _matrix_point_mul(matrix, &in[i], &rotated);
+
+                rotated.x += xt;
+                rotated.y += yt;
+                rotated.z += zt;
+
+                int32_t z;
+                z = FIX2INT(rotated.z);
+
+                if (z < PROJECT_Z_MIN) {
+                        z = PROJECT_Z_MIN;
+                } else if (z > PROJECT_Z_MAX) {
+                        z = PROJECT_Z_MAX;
+                }
+
+                const int32_t scale = _project_scale[z - PROJECT_Z_MIN];
+
+                out[i].x = _camera.x +
+                    FIX2INT((rotated.x * scale) >> PROJECT_SCALE_SHIFT);
+                out[i].y = _camera.y +
+                    FIX2INT((rotated.y * scale) >> PROJECT_SCALE_SHIFT);
+                out[i].z = rotated.z;
         }
 }
 
-static void
-_project(point *in, point *out, int32_t n)
+static inline int32_t __always_inline
+_quad_z(const quad *f, const point *p)
 {
-        int32_t i;
+        return p[f->p0].z + p[f->p1].z + p[f->p2].z + p[f->p3].z;
+}
 
-        for (i = 0; i < n; i++) {
-                out[i].x = _camera.x + FIX2INT(((in[i].x * _camera.z) / (_camera.z - FIX2INT(in[i].z))));
-                out[i].y = _camera.y + FIX2INT(((in[i].y * _camera.z) / (_camera.z - FIX2INT(in[i].z))));
-                out[i].z = in[i].z;
-        }
+static inline uint16_t __always_inline
+_sort_depth(int32_t z)
+{
+        /* Quads with the largest Z are drawn first, so invert the key for
+         * the ascending radix sort */
+        return SORT_DEPTH_BIAS - (z >> SORT_DEPTH_SHIFT);
 }
 
 static void
 _sort_quads(quad *f, point *p, int32_t *order, int32_t n)
 {
         int32_t i;
-        int32_t j;
-        int32_t tmp;
 
-        /* Initialize arrays */
         for (i = 0; i < n; i++) {
-                _avg_z[i] = p[f[i].p0].z +
-                            p[f[i].p1].z +
-                            p[f[i].p2].z +
-                            p[f[i].p3].z;
-                order[i] = i;
+                _sort_pairs[i].depth = _sort_depth(_quad_z(&f[i], p));
+                _sort_pairs[i].index = i;
+        }
+
+        radix_sort(_sort_pairs, n);
+
+        for (i = 0; i < n; i++) {
+                order[i] = _sort_pairs[i].index;
+
+                _avg_z[i] = _quad_z(&f[order[i]], p);
         }
+}
 
+static void __unused
+_bubble_sort(int32_t *avg_z, int32_t *order, int32_t n)
+{
+        int32_t i;
+        int32_t j;
+        int32_t tmp;
 
         /* Bubble-sort the whole lot... yeehaw! */
         for (i = 0; i < (n - 1); i++) {
                 for (j = i + 1; j < n; j++) {
-                        if (_avg_z[j] > _avg_z[i]) {
-                                tmp = _avg_z[i];
-                                _avg_z[i] = _avg_z[j];
-                                _avg_z[j] = tmp;
+                        if (avg_z[j] > avg_z[i]) {
+                                tmp = avg_z[i];
+                                avg_z[i] = avg_z[j];
+                                avg_z[j] = tmp;
                                 tmp = order[i];
                                 order[i] = order[j];
                                 order[j] = tmp;
@@ -628,3 +820,173 @@ _hardware_init(void)
 
         vdp2_tvmd_display_set();
 }
+
+#if SORT_BENCHMARK == 1
+static void
+_sort_benchmark(void)
+{
+        _benchmark_init();
+
+        /* Spread the depths over the same range as the summed Z of a quad */
+        uint32_t seed;
+        seed = 0x2545F491;
+
+        for (int32_t i = 0; i < BENCHMARK_FACE_COUNT_MAX; i++) {
+                seed = (seed * 1103515245) + 12345;
+
+                _benchmark_z[i] = ((int32_t)(seed >> 8) % INT2FIX(360));
+        }
+
+        dbgio_printf("\n faces   bubble (ms)   radix (ms)\n");
+
+        for (uint32_t i = 0; i < ELEMENT_COUNT(_benchmark_face_counts); i++) {
+                const int32_t n = _benchmark_face_counts[i];
+
+                /* Both timings go from the raw depths to a draw order, so
+                 * building each sort's input is counted on both sides */
+                _benchmark_ticks_reset();
+
+                for (int32_t j = 0; j < n; j++) {
+                        _benchmark_avg_z[j] = _benchmark_z[j];
+                        _benchmark_order[j] = j;
+                }
+
+                _bubble_sort(_benchmark_avg_z, _benchmark_order, n);
+
+                const uint32_t bubble_ticks = _benchmark_ticks_get();
+
+                _benchmark_ticks_reset();
+
+                for (int32_t j = 0; j < n; j++) {
+                        _benchmark_pairs[j].depth = _sort_depth(_benchmark_z[j]);
+                        _benchmark_pairs[j].index = j;
+                }
+
+                radix_sort(_benchmark_pairs, n);
+
+                for (int32_t j = 0; j < n; j++) {
+                        _benchmark_order[j] = _benchmark_pairs[j].index;
+                }
+
+                const uint32_t radix_ticks = _benchmark_ticks_get();
+
+                const uint32_t bubble_us =
+                    _benchmark_ticks_us_convert(bubble_ticks);
+                const uint32_t radix_us =
+                    _benchmark_ticks_us_convert(radix_ticks);
+
+                dbgio_printf(" %5li %8lu.%03lu %8lu.%03lu\n",
+                    n,
+                    bubble_us / 1000, bubble_us % 1000,
+                    radix_us / 1000, radix_us % 1000);
+        }
+
+        dbgio_flush();
+        vdp_sync();
+
+        while (true) {
+        }
+}
+
+#endif /* SORT_BENCHMARK */
+
+#if ROTATE_BENCHMARK == 1
+static void
+_rotate_benchmark(void)
+{
+        _benchmark_init();
+
+        const int32_t san = _sintb[0x20];
+        const int32_t can = _sintb[0x20 + 0x40];
+
+        const uint32_t vertex_count =
+            MODEL_POINT_COUNT * BENCHMARK_ROTATE_PASS_COUNT;
+
+        matrix rotation;
+
+        dbgio_printf("\n %lu vertices\n", vertex_count);
+        dbgio_printf("\n kernel      total (ms)   per vertex (us)\n");
+
+        _benchmark_ticks_reset();
+
+        for (uint32_t pass = 0; pass < BENCHMARK_ROTATE_PASS_COUNT; pass++) {
+                for (uint32_t i = 0; i < MODEL_POINT_COUNT; i++) {
+                        _rotate_point(&_scene_points[i], &_benchmark_points[i],
+                            san, can);
+                }
+        }
+
+        const uint32_t axis_ticks = _benchmark_ticks_get();
+
+        _benchmark_ticks_reset();
+
+        for (uint32_t pass = 0; pass < BENCHMARK_ROTATE_PASS_COUNT; pass++) {
+                /* Include building the matrix, as it's done once per frame */
+                _matrix_rotation_set(&rotation, 0x20, 0x20, 0x20);
+
+                for (uint32_t i = 0; i < MODEL_POINT_COUNT; i++) {
+                        _matrix_point_mul(&rotation, &_scene_points[i],
+                            &_benchmark_points[i]);
+                }
+        }
+
+        const uint32_t matrix_ticks = _benchmark_ticks_get();
+
+        const uint32_t axis_us = _benchmark_ticks_us_convert(axis_ticks);
+        const uint32_t matrix_us = _benchmark_ticks_us_convert(matrix_ticks);
+
+        dbgio_printf(" per-axis %6lu.%03lu %10lu.%03lu\n",
+            axis_us / 1000, axis_us % 1000,
+            axis_us / vertex_count, ((axis_us * 1000) / vertex_count) % 1000);
+        dbgio_printf(" matrix   %6lu.%03lu %10lu.%03lu\n",
+            matrix_us / 1000, matrix_us % 1000,
+            matrix_us / vertex_count, ((matrix_us * 1000) / vertex_count) % 1000);
+
+        dbgio_flush();
+        vdp_sync();
+
+        while (true) {
+        }
+}
+#endif /* ROTATE_BENCHMARK */
+
+#if (SORT_BENCHMARK == 1) || (ROTATE_BENCHMARK == 1)
+static void
+_benchmark_init(void)
+{
+        dbgio_dev_default_init(DBGIO_DEV_VDP2_ASYNC);
+        dbgio_dev_font_load();
+        dbgio_dev_font_load_wait();
+
+        cpu_frt_init(CPU_FRT_CLOCK_DIV_128);
+        cpu_frt_ovi_set(_frt_ovi_handler);
+}
+
+static uint32_t
+_benchmark_ticks_get(void)
+{
+        const uint16_t count = cpu_frt_count_get();
+
+        return (_frt_ovi_count << 16) | count;
+}
+
+static void
+_benchmark_ticks_reset(void)
+{
+        cpu_frt_count_set(0);
+
+        _frt_ovi_count = 0;
+}
+
+static uint32_t
+_benchmark_ticks_us_convert(uint32_t ticks)
+{
+        return (ticks * 1000) / CPU_FRT_NTSC_320_128_COUNT_1MS;
+}
+
+static void
+_frt_ovi_handler(void)
+{
+        _frt_ovi_count++;
+}
+#endif /* SORT_BENCHMARK || ROTATE_BENCHMARK */
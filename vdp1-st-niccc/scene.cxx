@@ -10,11 +10,20 @@
 
 #include "scene.h"
 
+// Bit-fields are allocated starting from the MSB on the SH-2. Flip the
+// declarations when building on a little-endian host (see tools/)
 struct frame_flags {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    unsigned int clear_screen:1;
+    unsigned int contains_palette_data:1;
+    unsigned int index_mode:1;
+    unsigned int :5;
+#else
     unsigned int :5;
     unsigned int index_mode:1;
     unsigned int contains_palette_data:1;
     unsigned int clear_screen:1;
+#endif
 } __attribute__ ((packed));
 
 struct uint8_vector {
@@ -30,8 +39,13 @@ enum polygon_descriptor_flags {
 
 union polygon_descriptor {
     struct {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+        unsigned int vertex_count:4;
+        unsigned int palette_index:4;
+#else
         unsigned int palette_index:4;
         unsigned int vertex_count:4;
+#endif
     } __attribute__ ((packed)) encoded;
 
     polygon_descriptor_flags flag;
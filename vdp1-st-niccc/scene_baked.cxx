@@ -0,0 +1,210 @@
+/*
+ * Copyright (c) 2012-2019 Israel Jacquez
+ * See LICENSE for details.
+ *
+ * Israel Jacquez <mrkotfw@gmail.com>
+ */
+
+#include <stddef.h>
+#include <string.h>
+
+#include "scene.h"
+#include "scene_baked.h"
+
+static constexpr int16_t _screen_width = 320;
+static constexpr int16_t _screen_height = 240;
+
+// VDP1 command table layout (offsets in bytes)
+static constexpr uint32_t _cmd_ctrl = 0x00;
+static constexpr uint32_t _cmd_pmod = 0x04;
+static constexpr uint32_t _cmd_colr = 0x06;
+static constexpr uint32_t _cmd_xa = 0x0C;
+static constexpr uint32_t _cmd_ya = 0x0E;
+static constexpr uint32_t _cmd_xc = 0x14;
+static constexpr uint32_t _cmd_yc = 0x16;
+
+static constexpr uint16_t _cmd_ctrl_polygon = 0x0004;
+static constexpr uint16_t _cmd_ctrl_system_clip_coord = 0x0009;
+static constexpr uint16_t _cmd_ctrl_local_coord = 0x000A;
+static constexpr uint16_t _cmd_ctrl_end = 0x8000;
+
+// Pre-clipping disabled, color bank mode (the color is in CMDCOLR)
+static constexpr uint16_t _polygon_draw_mode = 0x0800;
+
+static uint8_t* _output;
+static size_t _output_size;
+static size_t _output_capacity;
+static bool _output_overflow;
+
+static size_t _frame_offset;
+static uint16_t _palette_mask;
+static uint16_t _palette[16];
+static uint16_t _polygon_count;
+static bool _clear_screen;
+static bool _last_frame;
+
+static void _write16(size_t offset, uint16_t value) {
+    if ((offset + 2) > _output_capacity) {
+        return;
+    }
+
+    _output[offset] = value >> 8;
+    _output[offset + 1] = value & 0xFF;
+}
+
+static void _write32(size_t offset, uint32_t value) {
+    _write16(offset, value >> 16);
+    _write16(offset + 2, value & 0xFFFF);
+}
+
+// Appends size zeroed bytes to the output, and returns their offset. Once the
+// output is full, nothing more is written, and the bake fails
+static size_t _output_alloc(size_t size) {
+    const size_t offset = _output_size;
+
+    if ((offset + size) > _output_capacity) {
+        _output_overflow = true;
+    } else {
+        (void)memset(&_output[offset], 0x00, size);
+    }
+
+    _output_size = offset + size;
+
+    return offset;
+}
+
+static size_t _cmdt_alloc(uint16_t ctrl) {
+    const size_t offset = _output_alloc(scene_baked::cmdt_size);
+
+    _write16(offset + _cmd_ctrl, ctrl);
+
+    return offset;
+}
+
+static void _vertex_write(size_t offset, uint32_t vertex, int16_vec2_t const& v) {
+    _write16(offset + _cmd_xa + (vertex * 4), v.x);
+    _write16(offset + _cmd_ya + (vertex * 4), v.y);
+}
+
+static void _on_start(uint32_t, bool) {
+    _frame_offset = _output_alloc(sizeof(scene_baked::frame_header));
+
+    _palette_mask = 0x0000;
+    _polygon_count = 0;
+
+    const size_t clip_offset = _cmdt_alloc(_cmd_ctrl_system_clip_coord);
+
+    _write16(clip_offset + _cmd_xc, _screen_width - 1);
+    _write16(clip_offset + _cmd_yc, _screen_height - 1);
+
+    (void)_cmdt_alloc(_cmd_ctrl_local_coord);
+}
+
+static void _on_end(uint32_t, bool last_frame) {
+    (void)_cmdt_alloc(_cmd_ctrl_end);
+
+    const size_t cmdt_count =
+        (_output_size - _frame_offset - sizeof(scene_baked::frame_header)) /
+        scene_baked::cmdt_size;
+
+    uint16_t flags = 0x0000;
+
+    if (_clear_screen) {
+        flags |= scene_baked::frame_flag_clear_screen;
+    }
+
+    if (last_frame) {
+        flags |= scene_baked::frame_flag_last_frame;
+    }
+
+    _write16(_frame_offset + offsetof(scene_baked::frame_header, cmdt_count), cmdt_count);
+    _write16(_frame_offset + offsetof(scene_baked::frame_header, polygon_count), _polygon_count);
+    _write16(_frame_offset + offsetof(scene_baked::frame_header, flags), flags);
+    _write16(_frame_offset + offsetof(scene_baked::frame_header, palette_mask), _palette_mask);
+
+    for (uint32_t i = 0; i < 16; i++) {
+        if ((_palette_mask & (1 << i)) != 0) {
+            _write16(_frame_offset + offsetof(scene_baked::frame_header, palette) + (i * 2), _palette[i]);
+        }
+    }
+
+    _last_frame = last_frame;
+}
+
+static void _on_update_palette(uint8_t palette_index, const scene::rgb444 color) {
+    // Same as COLOR_RGB1555(1, r << 2, g << 2, b << 2)
+    const uint16_t r = color.r << 2;
+    const uint16_t g = color.g << 2;
+    const uint16_t b = color.b << 2;
+
+    _palette[palette_index] = 0x8000 | (b << 10) | (g << 5) | r;
+    _palette_mask |= 1 << palette_index;
+}
+
+static void _on_clear_screen(bool clear_screen) {
+    _clear_screen = clear_screen;
+}
+
+// Cover the (convex) polygon with a fan of quads, two triangles at a time.
+// An odd triangle left over is drawn as a quad with a repeated vertex
+static void _on_draw(int16_vec2_t const* vertex_buffer, const size_t count,
+                     const uint8_t palette_index) {
+    for (size_t i = 1; (i + 1) < count; i += 2) {
+        const size_t offset = _cmdt_alloc(_cmd_ctrl_polygon);
+
+        _write16(offset + _cmd_pmod, _polygon_draw_mode);
+        _write16(offset + _cmd_colr, palette_index + 0x10);
+
+        const size_t last = ((i + 2) < count) ? (i + 2) : (i + 1);
+
+        _vertex_write(offset, 0, vertex_buffer[0]);
+        _vertex_write(offset, 1, vertex_buffer[i]);
+        _vertex_write(offset, 2, vertex_buffer[i + 1]);
+        _vertex_write(offset, 3, vertex_buffer[last]);
+    }
+
+    _polygon_count++;
+}
+
+size_t scene_baked::bake(const uint8_t* scene_buffer, uint8_t* out, size_t out_size) {
+    scene::callbacks callbacks;
+    callbacks.on_start = _on_start;
+    callbacks.on_end = _on_end;
+    callbacks.on_clear_screen = _on_clear_screen;
+    callbacks.on_update_palette = _on_update_palette;
+    callbacks.on_draw = _on_draw;
+
+    const uint8_t* scene_ptr = scene_buffer;
+
+    scene::init(scene_ptr, callbacks);
+
+    _output = out;
+    _output_size = 0;
+    _output_capacity = out_size;
+    _output_overflow = false;
+
+    (void)_output_alloc(sizeof(scene_baked::file_header));
+
+    uint32_t frame_count = 0;
+
+    _last_frame = false;
+
+    while (!_last_frame && !_output_overflow) {
+        scene::process_frame();
+
+        frame_count++;
+    }
+
+    if (_output_overflow) {
+        return 0;
+    }
+
+    // The magic goes in last, so a bake that didn't finish is never
+    // mistaken for a valid file
+    _write16(offsetof(scene_baked::file_header, version), scene_baked::version);
+    _write16(offsetof(scene_baked::file_header, frame_count), frame_count);
+    _write32(offsetof(scene_baked::file_header, size), _output_size);
+    _write32(offsetof(scene_baked::file_header, magic), scene_baked::magic);
+
+    return _output_size;
+}
@@ -0,0 +1,55 @@
+#ifndef SCENE_BAKED_H_
+#define SCENE_BAKED_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Pre-baked form of SCENE.BIN, produced by scene_baked::bake(). That's run on
+// the host by tools/scene-conv, or by the example itself at boot
+//
+// The file starts with a scene_baked::file_header, followed by one record
+// per frame. A record is a scene_baked::frame_header followed by
+// frame_header::cmdt_count 32-byte VDP1 command tables (system clipping,
+// local coordinates, polygons, and a terminating end command), laid out
+// exactly as VDP1 expects them in VRAM. Every field is big-endian, and
+// every record is 32-byte aligned, so a frame's command tables can be
+// transferred to VDP1 VRAM with a single SCU DMA
+
+namespace scene_baked {
+    static constexpr uint32_t magic = 0x4E434D44; // "NCMD"
+    static constexpr uint16_t version = 1;
+
+    static constexpr uint32_t cmdt_size = 32;
+
+    static constexpr uint16_t frame_flag_clear_screen = 1 << 0;
+    static constexpr uint16_t frame_flag_last_frame = 1 << 1;
+
+    struct file_header {
+        uint32_t magic;
+        uint16_t version;
+        uint16_t frame_count;
+        uint32_t size; // Size of the whole file, in bytes
+        uint32_t reserved[5];
+    } __attribute__ ((packed, aligned(4)));
+
+    struct frame_header {
+        uint16_t cmdt_count;
+        uint16_t polygon_count;
+        uint16_t flags;
+        // Bit N is set when palette entry N changed in this frame. Only
+        // the changed entries of palette[] are valid
+        uint16_t palette_mask;
+        uint16_t palette[16];
+        uint16_t reserved[12];
+    } __attribute__ ((packed, aligned(4)));
+
+    static_assert(sizeof(file_header) == 32);
+    static_assert(sizeof(frame_header) == 64);
+
+    // Decodes all of scene_buffer (SCENE.BIN) and writes the baked form to
+    // out. Returns the size of the baked file, or 0 if it doesn't fit in
+    // out_size bytes
+    size_t bake(const uint8_t* scene_buffer, uint8_t* out, size_t out_size);
+};
+
+#endif // SCENE_BAKED_H_
@@ -0,0 +1,15 @@
+#ifndef TOOLS_FIX16_H_
+#define TOOLS_FIX16_H_
+
+// Host stand-in for libyaul's <fix16.h>. scene.cxx only needs the vector
+// type, so this is enough to build it with the host compiler
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct {
+    int16_t x;
+    int16_t y;
+} int16_vec2_t;
+
+#endif // TOOLS_FIX16_H_
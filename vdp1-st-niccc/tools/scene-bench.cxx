@@ -0,0 +1,164 @@
+/*
+ * Copyright (c) 2012-2019 Israel Jacquez
+ * See LICENSE for details.
+ *
+ * Israel Jacquez <mrkotfw@gmail.com>
+ */
+
+// Replays SCENE.BIN through scene::process_frame() with counting callbacks
+// to measure the decoder on the host
+//
+// Usage: scene-bench SCENE.BIN [passes]
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <chrono>
+#include <vector>
+
+#include "scene.h"
+
+static constexpr uint32_t _vertex_count_max = 16;
+
+static struct {
+    uint64_t frame_count;
+    uint64_t polygon_count;
+    uint64_t vertex_count;
+    uint64_t palette_update_count;
+    uint64_t clear_screen_count;
+    uint64_t vertex_histogram[_vertex_count_max];
+
+    uint32_t frame_polygon_count;
+    uint32_t frame_polygon_count_max;
+    bool last_frame;
+} _stats;
+
+static void _on_start(uint32_t, bool) {
+    _stats.frame_polygon_count = 0;
+}
+
+static void _on_end(uint32_t, bool last_frame) {
+    _stats.frame_count++;
+
+    if (_stats.frame_polygon_count > _stats.frame_polygon_count_max) {
+        _stats.frame_polygon_count_max = _stats.frame_polygon_count;
+    }
+
+    _stats.last_frame = last_frame;
+
+    if (last_frame) {
+        scene::reset();
+    }
+}
+
+static void _on_update_palette(uint8_t, const scene::rgb444) {
+    _stats.palette_update_count++;
+}
+
+static void _on_clear_screen(bool clear_screen) {
+    if (clear_screen) {
+        _stats.clear_screen_count++;
+    }
+}
+
+static void _on_draw(int16_vec2_t const*, const size_t count, const uint8_t) {
+    _stats.polygon_count++;
+    _stats.vertex_count += count;
+    _stats.vertex_histogram[count & (_vertex_count_max - 1)]++;
+    _stats.frame_polygon_count++;
+}
+
+int main(int argc, char* argv[]) {
+    if ((argc != 2) && (argc != 3)) {
+        fprintf(stderr, "Usage: %s SCENE.BIN [passes]\n", argv[0]);
+
+        return 1;
+    }
+
+    const uint32_t pass_count = (argc == 3) ? strtoul(argv[2], nullptr, 0) : 100;
+
+    if (pass_count == 0) {
+        fprintf(stderr, "%s: Invalid number of passes\n", argv[0]);
+
+        return 1;
+    }
+
+    FILE* const fp = fopen(argv[1], "rb");
+
+    if (fp == nullptr) {
+        perror(argv[1]);
+
+        return 1;
+    }
+
+    std::vector<uint8_t> scene_buffer;
+
+    uint8_t read_buffer[4096];
+    size_t read_size;
+
+    while ((read_size = fread(read_buffer, 1, sizeof(read_buffer), fp)) > 0) {
+        scene_buffer.insert(scene_buffer.end(), read_buffer, read_buffer + read_size);
+    }
+
+    fclose(fp);
+
+    scene::callbacks callbacks;
+    callbacks.on_start = _on_start;
+    callbacks.on_end = _on_end;
+    callbacks.on_clear_screen = _on_clear_screen;
+    callbacks.on_update_palette = _on_update_palette;
+    callbacks.on_draw = _on_draw;
+
+    const uint8_t* scene_ptr = scene_buffer.data();
+
+    scene::init(scene_ptr, callbacks);
+
+    const auto start = std::chrono::steady_clock::now();
+
+    for (uint32_t pass = 0; pass < pass_count; pass++) {
+        _stats.last_frame = false;
+
+        while (!_stats.last_frame) {
+            scene::process_frame();
+        }
+    }
+
+    const auto end = std::chrono::steady_clock::now();
+
+    const double seconds = std::chrono::duration<double>(end - start).count();
+
+    const uint64_t frame_count = _stats.frame_count / pass_count;
+    const uint64_t polygon_count = _stats.polygon_count / pass_count;
+    const double byte_count = static_cast<double>(scene_buffer.size()) * pass_count;
+
+    printf("%s: %" PRIu64 " frames, %zu bytes, %" PRIu32 " passes in %.3fs\n",
+           argv[1], frame_count, scene_buffer.size(), pass_count, seconds);
+    printf("\n");
+    printf("frames/s:        %.1f\n", _stats.frame_count / seconds);
+    printf("MiB/s:           %.2f\n", byte_count / seconds / (1024.0 * 1024.0));
+    printf("ns/frame:        %.1f\n", (seconds * 1e9) / _stats.frame_count);
+    printf("\n");
+    printf("polygons:        %" PRIu64 "\n", polygon_count);
+    printf("polygons/frame:  %.1f (max %" PRIu32 ")\n",
+           static_cast<double>(polygon_count) / frame_count,
+           _stats.frame_polygon_count_max);
+    printf("vertices/frame:  %.1f\n",
+           static_cast<double>(_stats.vertex_count / pass_count) / frame_count);
+    printf("palette updates: %" PRIu64 "\n", _stats.palette_update_count / pass_count);
+    printf("clear screens:   %" PRIu64 "\n", _stats.clear_screen_count / pass_count);
+    printf("\n");
+    printf("vertex count histogram:\n");
+
+    for (uint32_t i = 0; i < _vertex_count_max; i++) {
+        const uint64_t count = _stats.vertex_histogram[i] / pass_count;
+
+        if (count == 0) {
+            continue;
+        }
+
+        printf("%5" PRIu32 ": %8" PRIu64 " (%5.1f%%)\n", i, count, (100.0 * count) / polygon_count);
+    }
+
+    return 0;
+}
@@ -0,0 +1,89 @@
+/*
+ * Copyright (c) 2012-2019 Israel Jacquez
+ * See LICENSE for details.
+ *
+ * Israel Jacquez <mrkotfw@gmail.com>
+ */
+
+// Converts SCENE.BIN into the pre-baked VDP1 command stream described in
+// scene_baked.h
+//
+// Usage: scene-conv SCENE.BIN SCENE.CMD
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <vector>
+
+#include "scene.h"
+#include "scene_baked.h"
+
+// The baked file's size field is 32-bit, but anything this large wouldn't fit
+// in the extended RAM cartridge anyway
+static constexpr size_t _output_size_max = 16 * 1024 * 1024;
+
+int main(int argc, char* argv[]) {
+    if (argc != 3) {
+        fprintf(stderr, "Usage: %s SCENE.BIN SCENE.CMD\n", argv[0]);
+
+        return 1;
+    }
+
+    FILE* const in_fp = fopen(argv[1], "rb");
+
+    if (in_fp == nullptr) {
+        perror(argv[1]);
+
+        return 1;
+    }
+
+    std::vector<uint8_t> scene_buffer;
+
+    uint8_t read_buffer[4096];
+    size_t read_size;
+
+    while ((read_size = fread(read_buffer, 1, sizeof(read_buffer), in_fp)) > 0) {
+        scene_buffer.insert(scene_buffer.end(), read_buffer, read_buffer + read_size);
+    }
+
+    fclose(in_fp);
+
+    std::vector<uint8_t> output(_output_size_max);
+
+    const size_t output_size =
+        scene_baked::bake(scene_buffer.data(), output.data(), output.size());
+
+    if (output_size == 0) {
+        fprintf(stderr, "%s: Baked scene is larger than %zu bytes\n", argv[1],
+                _output_size_max);
+
+        return 1;
+    }
+
+    output.resize(output_size);
+
+    const uint16_t frame_count =
+        (output[offsetof(scene_baked::file_header, frame_count)] << 8) |
+        output[offsetof(scene_baked::file_header, frame_count) + 1];
+
+    FILE* const out_fp = fopen(argv[2], "wb");
+
+    if (out_fp == nullptr) {
+        perror(argv[2]);
+
+        return 1;
+    }
+
+    if (fwrite(output.data(), 1, output.size(), out_fp) != output.size()) {
+        perror(argv[2]);
+        fclose(out_fp);
+
+        return 1;
+    }
+
+    fclose(out_fp);
+
+    printf("%s: %u frames, %zu bytes\n", argv[2], frame_count, output.size());
+
+    return 0;
+}
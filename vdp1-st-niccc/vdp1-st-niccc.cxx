@@ -10,13 +10,34 @@
 #include <yaul.h>
 
 #include "scene.h"
+#include "scene_baked.h"
 
 #define ORDER_SYSTEM_CLIP_COORDS_INDEX      0
 #define ORDER_LOCAL_COORDS_INDEX            1
 #define ORDER_BUFFER_STARTING_INDEX         2
-#define ORDER_BUFFER_END_INDEX              (ORDER_BUFFER_STARTING_INDEX + 256)
-#define ORDER_DRAW_END_INDEX                (ORDER_BUFFER_END_INDEX + 1)
-#define ORDER_COUNT                         ORDER_DRAW_END_INDEX
+/* The two command tables above, and the end command table */
+#define ORDER_EXTRA_COUNT                   (ORDER_BUFFER_STARTING_INDEX + 1)
+
+/* Polygon command tables a frame slot's arena starts with, and the most it
+ * can grow to */
+#define ORDER_BUFFER_COUNT_INITIAL          256
+#define ORDER_BUFFER_COUNT_MAX              2048
+
+#define CMDT_LIST_SPLIT         0 /* 0: Submit a frame as one VDP1 list   1: Split dense frames across two lists */
+#define CMDT_LIST_SPLIT_COUNT   (ORDER_BUFFER_STARTING_INDEX + 256)
+
+#define DECODE_SLAVE    1 /* 0: Decode on the master   1: Decode frame N+1 on the slave */
+
+#define PLAYBACK_BAKED  0 /* 0: Decode SCENE.BIN   1: Play back SCENE.CMD, baked at boot into the extended RAM cartridge */
+
+#define PLAYBACK_PACED  1 /* 0: Play back a frame per vdp_sync()   1: Play back at a fixed rate, skipping stale frames */
+
+#define PLAYBACK_VBLANKS_PER_FRAME      2 /* 30 frames/s */
+
+#define FRAME_SLOT_STATE_FREE   0
+#define FRAME_SLOT_STATE_READY  1
+
+#define FRAME_SLOT_COUNT        2
 
 static constexpr uint32_t _screen_width = 320;
 static constexpr uint32_t _screen_height = 240;
@@ -33,16 +54,106 @@ static void* _romdisk;
 
 static smpc_peripheral_digital_t _digital;
 
-static vdp1_cmdt_list_t* _scene_cmdt_list;
+/* A decoded frame, ready to be submitted. The decoder (the slave when
+ * DECODE_SLAVE is set) fills a slot while the master submits the other */
+struct frame_slot {
+    /* The command table arena. It's only grown by the master, and only while
+     * the slot is free */
+    vdp1_cmdt_list_t* cmdt_list;
+    vdp1_cmdt_t* cmdts;
+    uint16_t cmdt_capacity;
+    /* Set when the arena was (re)allocated. The decoder's cache may still
+     * hold lines of whatever used the heap block before, so it has to purge
+     * them before it reads back the command tables it updates */
+    bool cmdt_arena_new;
+
+    /* Bit N of palette_mask is set when palette entry N changed in this
+     * frame. Only the changed entries of palette[] are valid */
+    color_rgb1555_t palette[16];
+    uint16_t palette_mask;
+
+    volatile uint32_t state;
+
+    uint32_t frame_index;
+    uint16_t cmdt_count;
+    uint16_t polygon_count;
+    /* Polygon command tables the frame needed. When it's larger than
+     * cmdt_capacity, the polygons that didn't fit were dropped */
+    uint16_t cmdt_required;
+    bool last_frame;
+    bool clear_screen;
+} __aligned(32);
+
+static frame_slot _frame_slots[FRAME_SLOT_COUNT] __section(".uncached");
+
+/* Only touched by the decoder */
+static volatile uint32_t _decode_index __section(".uncached");
+static frame_slot* _emit_slot;
+/* Polygon command tables written to the arena, and the tables the frame
+ * needs, including those of the polygons that were dropped */
 static uint32_t _cmdt_buffer_index;
-
-static color_rgb1555_t _palette[16] __aligned(32);
+static uint32_t _cmdt_required_count;
+
+/* Only touched by the master */
+static uint32_t _submit_index;
+static vdp1_cmdt_list_t _submit_cmdt_lists[2];
+
+/* A copy of the scene's palette in CRAM, and the source of the palette
+ * transfers */
+static color_rgb1555_t _palette_buffer[16] __aligned(32);
+/* Entries of _palette_buffer not yet transferred to CRAM */
+static uint16_t _palette_pending_mask;
+
+static volatile uint32_t _vblank_count;
+
+static struct {
+    /* VBLANK count at which the first frame was due */
+    uint32_t vblank_start;
+    /* Frames played back, drawn or skipped */
+    uint32_t frame_count;
+    uint32_t skipped_count;
+    /* Set when a skipped frame cleared the screen */
+    bool clear_screen;
+} _playback;
+
+static struct {
+    uint16_t high_water;
+    uint32_t overflow_count;
+} _cmdt_stats;
+
+static const scene_baked::file_header* _baked_file_header;
+static const uint8_t* _baked_frame;
+static uint32_t _baked_frame_index;
+static vdp1_cmdt_list_t _baked_cmdt_list;
 
 static void _hardware_init(void);
 static void _romdisk_init(void);
 
 static void _draw_init(void);
 
+static void _frame_slot_arena_alloc(frame_slot*, uint16_t);
+
+static void _frame_decode(frame_slot*);
+static frame_slot* _frame_decode_wait(void);
+static void _frame_submit(frame_slot*);
+static void _frame_release(frame_slot*);
+
+static void _slave_entry(void);
+
+static void _frame_skip(frame_slot*);
+
+static void _playback_clock_reset(void);
+static uint32_t _playback_frame_due(void);
+
+static void _palette_merge(const color_rgb1555_t*, uint16_t);
+static void _palette_flush(void);
+
+static void _baked_init(void);
+static void _baked_frame_submit(void);
+static void _baked_frame_skip(void);
+static void _baked_frame_advance(void);
+
+static void _vblank_in_handler(void *);
 static void _vblank_out_handler(void *);
 
 static void _on_start(uint32_t, bool);
@@ -51,21 +162,27 @@ static void _on_clear_screen(bool);
 static void _on_update_palette(uint8_t, const scene::rgb444);
 static void _on_draw(int16_vec2_t const *, const size_t, const uint8_t);
 
-static void _on_draw_polygon3(int16_vec2_t const *, const size_t, const uint8_t) __unused;
-static void _on_draw_polygon4(int16_vec2_t const *, const size_t, const uint8_t) __unused;
-static void _on_draw_polygon5(int16_vec2_t const *, const size_t, const uint8_t) __unused;
-static void _on_draw_polygon6(int16_vec2_t const *, const size_t, const uint8_t) __unused;
-static void _on_draw_polygon7(int16_vec2_t const *, const size_t, const uint8_t) __unused;
+template <size_t N>
+static void _on_draw_polygon(int16_vec2_t const *, const size_t, const uint8_t);
 
-static const scene::draw_handler _draw_handlers[] = {
+/* The polygon descriptor's vertex count is 4 bits wide */
+static const scene::draw_handler _draw_handlers[16] = {
     nullptr, // 0
     nullptr, // 1
     nullptr, // 2
-    _on_draw_polygon3,
-    _on_draw_polygon4,
-    _on_draw_polygon5,
-    _on_draw_polygon6,
-    _on_draw_polygon7
+    _on_draw_polygon<3>,
+    _on_draw_polygon<4>,
+    _on_draw_polygon<5>,
+    _on_draw_polygon<6>,
+    _on_draw_polygon<7>,
+    _on_draw_polygon<8>,
+    _on_draw_polygon<9>,
+    _on_draw_polygon<10>,
+    _on_draw_polygon<11>,
+    _on_draw_polygon<12>,
+    _on_draw_polygon<13>,
+    _on_draw_polygon<14>,
+    _on_draw_polygon<15>
 };
 
 void main(void) {
@@ -78,6 +195,9 @@ void main(void) {
 
     _draw_init();
 
+#if PLAYBACK_BAKED == 1
+    _baked_init();
+#else
     void *fh = romdisk_open(_romdisk, _scene_file_path);
     assert(fh != NULL);
     void *scene_ptr = romdisk_direct(fh);
@@ -92,8 +212,19 @@ void main(void) {
 
     scene::init(scene_buffer, callbacks);
 
+#if DECODE_SLAVE == 1
+    cpu_dual_init(CPU_DUAL_ENTRY_ICI);
+    cpu_dual_slave_set(_slave_entry);
+
+    /* Prime the pipeline with the first frame */
+    cpu_dual_slave_notify();
+#endif /* DECODE_SLAVE */
+#endif /* PLAYBACK_BAKED */
+
     bool start_state = false;
 
+    _playback_clock_reset();
+
     while (true) {
         smpc_peripheral_process();
         smpc_peripheral_digital_port(1, &_digital);
@@ -103,20 +234,68 @@ void main(void) {
         }
 
         bool process_frame = start_state;
+        uint32_t stale_count = 0;
 
         if ((_digital.held.button.r) != 0) {
             process_frame = true;
         }
 
+#if PLAYBACK_PACED == 1
+        if (!start_state || ((_digital.held.button.r) != 0)) {
+            /* Paused or stepping, so hold the clock at the current frame */
+            _playback_clock_reset();
+        } else {
+            const uint32_t frame_due = _playback_frame_due();
+
+            if (_playback.frame_count > frame_due) {
+                /* Ahead of the clock, so keep the current frame up */
+                process_frame = false;
+            } else {
+                stale_count = frame_due - _playback.frame_count;
+            }
+        }
+#endif /* PLAYBACK_PACED */
+
+        frame_slot* slot = nullptr;
+
         if (process_frame) {
             dbgio_puts("[H[2J");
 
-            scene::process_frame();
+#if PLAYBACK_BAKED == 1
+            for (; stale_count > 0; stale_count--) {
+                _baked_frame_skip();
+            }
+
+            _baked_frame_submit();
+#else
+            slot = _frame_decode_wait();
+
+            /* Frames that are past their time are still decoded, so that the
+             * palette and clear state carry over, but they're never drawn */
+            for (; stale_count > 0; stale_count--) {
+                _frame_skip(slot);
+                _frame_release(slot);
+
+                slot = _frame_decode_wait();
+            }
+
+            _frame_submit(slot);
+#endif /* PLAYBACK_BAKED */
+
+#if PLAYBACK_PACED == 1
+            dbgio_printf("skipped: %lu\n", _playback.skipped_count);
+#endif /* PLAYBACK_PACED */
 
             dbgio_flush();
         }
 
         vdp_sync();
+
+        /* The command tables have been transferred, so the slot can be
+         * decoded into again */
+        if (slot != nullptr) {
+            _frame_release(slot);
+        }
     }
 
     __builtin_unreachable();
@@ -150,6 +329,7 @@ static void _hardware_init(void) {
 
     vdp1_env_set(&vdp1_env);
 
+    vdp_sync_vblank_in_set(_vblank_in_handler);
     vdp_sync_vblank_out_set(_vblank_out_handler);
 }
 
@@ -163,6 +343,24 @@ static void _romdisk_init(void) {
 }
 
 static void _draw_init(void) {
+    for (uint32_t slot_index = 0; slot_index < FRAME_SLOT_COUNT; slot_index++) {
+        frame_slot* const slot = &_frame_slots[slot_index];
+
+        slot->cmdt_list = nullptr;
+
+        _frame_slot_arena_alloc(slot, ORDER_BUFFER_COUNT_INITIAL);
+
+        slot->state = FRAME_SLOT_STATE_FREE;
+    }
+
+    _decode_index = 0;
+    _submit_index = 0;
+
+    _cmdt_stats.high_water = 0;
+    _cmdt_stats.overflow_count = 0;
+}
+
+static void _frame_slot_arena_alloc(frame_slot* slot, uint16_t cmdt_capacity) {
     constexpr int16_vec2_t system_clip_coord =
         INT16_VEC2_INITIALIZER(_screen_width - 1,
                                _screen_height - 1);
@@ -175,11 +373,22 @@ static void _draw_init(void) {
     polygon_draw_mode.raw = 0x0000;
     polygon_draw_mode.bits.pre_clipping_disable = true;
 
-    _scene_cmdt_list = vdp1_cmdt_list_alloc(ORDER_COUNT);
+    const uint32_t cmdt_count = ORDER_EXTRA_COUNT + cmdt_capacity;
 
-    vdp1_cmdt_t* const cmdts = _scene_cmdt_list->cmdts;
+    if (slot->cmdt_list != nullptr) {
+        vdp1_cmdt_list_free(slot->cmdt_list);
+    }
 
-    (void)memset(&cmdts[0], 0x00, ORDER_COUNT * sizeof(vdp1_cmdt));
+    slot->cmdt_list = vdp1_cmdt_list_alloc(cmdt_count);
+    assert(slot->cmdt_list != NULL);
+
+    slot->cmdts = slot->cmdt_list->cmdts;
+    slot->cmdt_capacity = cmdt_capacity;
+    slot->cmdt_arena_new = true;
+
+    vdp1_cmdt_t* const cmdts = slot->cmdts;
+
+    (void)memset(&cmdts[0], 0x00, cmdt_count * sizeof(vdp1_cmdt));
 
     vdp1_cmdt_system_clip_coord_set(&cmdts[ORDER_SYSTEM_CLIP_COORDS_INDEX]);
     vdp1_cmdt_param_vertex_set(&cmdts[ORDER_SYSTEM_CLIP_COORDS_INDEX], CMDT_VTX_SYSTEM_CLIP, &system_clip_coord);
@@ -187,389 +396,417 @@ static void _draw_init(void) {
     vdp1_cmdt_local_coord_set(&cmdts[ORDER_LOCAL_COORDS_INDEX]);
     vdp1_cmdt_param_vertex_set(&cmdts[ORDER_LOCAL_COORDS_INDEX], CMDT_VTX_LOCAL_COORD, &local_coord_ul);
 
-    for (uint32_t i = ORDER_BUFFER_STARTING_INDEX; i < ORDER_BUFFER_END_INDEX; i++) {
+    for (uint32_t i = ORDER_BUFFER_STARTING_INDEX; i < (cmdt_count - 1); i++) {
         vdp1_cmdt_param_draw_mode_set(&cmdts[i], polygon_draw_mode);
     }
 
     vdp1_cmdt_end_set(&cmdts[ORDER_BUFFER_STARTING_INDEX]);
+
+    slot->cmdt_count = ORDER_BUFFER_STARTING_INDEX + 1;
 }
 
-static void _vblank_out_handler(void *) {
-    smpc_peripheral_intback_issue();
+static void _frame_decode(frame_slot* slot) {
+    _emit_slot = slot;
+    _cmdt_buffer_index = 0;
+    _cmdt_required_count = 0;
+
+    if (slot->cmdt_arena_new) {
+        cpu_cache_purge();
+
+        slot->cmdt_arena_new = false;
+    }
+
+    scene::process_frame();
+
+    slot->state = FRAME_SLOT_STATE_READY;
 }
 
-static void _on_start(uint32_t, bool) {
+static frame_slot* _frame_decode_wait(void) {
+#if DECODE_SLAVE == 1
+    frame_slot* const slot = &_frame_slots[_submit_index];
+
+    while (slot->state != FRAME_SLOT_STATE_READY) {
+    }
+
+    /* Have the slave decode the next frame into the other slot while this
+     * one is submitted */
+    cpu_dual_slave_notify();
+#else
+    frame_slot* const slot = &_frame_slots[_submit_index];
+
+    _frame_decode(slot);
+#endif /* DECODE_SLAVE */
+
+    return slot;
 }
 
-static void _on_end(uint32_t frame_index, bool last_frame) {
-    const uint32_t prev_buffer_index = _cmdt_buffer_index;
+static void _frame_submit(frame_slot* slot) {
+    if (!slot->clear_screen && !_playback.clear_screen) {
+        vdp1_sync_mode_set(VDP1_SYNC_MODE_CHANGE_ONLY);
+    } else {
+        vdp1_sync_mode_set(VDP1_SYNC_MODE_ERASE_CHANGE);
+    }
 
-    _cmdt_buffer_index = 0;
+    _playback.clear_screen = false;
+    _playback.frame_count++;
+
+    _palette_merge(slot->palette, slot->palette_mask);
+    _palette_flush();
 
-    dbgio_printf("i: %li, frame_index: %li\n", prev_buffer_index, frame_index);
+    dbgio_printf("i: %u, frame_index: %li\n", slot->polygon_count, slot->frame_index);
+    dbgio_printf("cmdts: %u/%u, hwm: %u, overflows: %lu\n",
+                 slot->cmdt_required,
+                 slot->cmdt_capacity,
+                 _cmdt_stats.high_water,
+                 _cmdt_stats.overflow_count);
 
     for (uint32_t i = 0; i < 28; i++) {
         dbgio_printf("%3li. 0x%03X: 0x%04X\n", i, (uint16_t)(i << 5), MEMORY_READ(16, VDP1_VRAM(i << 5)));
     }
 
-    const uint16_t end_index = ORDER_BUFFER_STARTING_INDEX +
-        prev_buffer_index;
+    _submit_cmdt_lists[0].cmdts = slot->cmdts;
+    _submit_cmdt_lists[0].count = slot->cmdt_count;
 
-    vdp1_cmdt* const end_cmdt = &_scene_cmdt_list->cmdts[end_index];
+#if CMDT_LIST_SPLIT == 1
+    /* Lists put in the same frame are appended to each other in VRAM, so
+     * only the second list carries the end command table */
+    if (slot->cmdt_count > CMDT_LIST_SPLIT_COUNT) {
+        _submit_cmdt_lists[0].count = CMDT_LIST_SPLIT_COUNT;
 
-    vdp1_cmdt_end_set(end_cmdt);
+        _submit_cmdt_lists[1].cmdts = &slot->cmdts[CMDT_LIST_SPLIT_COUNT];
+        _submit_cmdt_lists[1].count = slot->cmdt_count - CMDT_LIST_SPLIT_COUNT;
 
-    _scene_cmdt_list->count = end_index + 1;
+        vdp1_sync_cmdt_list_put(&_submit_cmdt_lists[0], NULL, NULL);
+        vdp1_sync_cmdt_list_put(&_submit_cmdt_lists[1], NULL, NULL);
 
-    vdp1_sync_cmdt_list_put(_scene_cmdt_list, NULL, NULL);
+        return;
+    }
+#endif /* CMDT_LIST_SPLIT */
 
-    if (last_frame) {
-        scene::reset();
+    vdp1_sync_cmdt_list_put(&_submit_cmdt_lists[0], NULL, NULL);
+}
+
+static void _frame_skip(frame_slot* slot) {
+    _playback.clear_screen |= slot->clear_screen;
+    _playback.frame_count++;
+    _playback.skipped_count++;
+
+    _palette_merge(slot->palette, slot->palette_mask);
+}
+
+static void _frame_release(frame_slot* slot) {
+    if (slot->cmdt_required > _cmdt_stats.high_water) {
+        _cmdt_stats.high_water = slot->cmdt_required;
+    }
+
+    /* Grow the arena so that the next frame as dense as this one fits. Half
+     * again as much is reserved to avoid growing a little at a time */
+    if (slot->cmdt_required > slot->cmdt_capacity) {
+        _cmdt_stats.overflow_count++;
+
+        uint32_t cmdt_capacity = slot->cmdt_required + (slot->cmdt_required / 2);
+
+        if (cmdt_capacity > ORDER_BUFFER_COUNT_MAX) {
+            cmdt_capacity = ORDER_BUFFER_COUNT_MAX;
+        }
+
+        if (cmdt_capacity > slot->cmdt_capacity) {
+            _frame_slot_arena_alloc(slot, cmdt_capacity);
+        }
     }
+
+    slot->state = FRAME_SLOT_STATE_FREE;
+
+#if DECODE_SLAVE == 1
+    _submit_index ^= 1;
+#endif /* DECODE_SLAVE */
 }
 
-static void _on_update_palette(uint8_t palette_index,
-                               const scene::rgb444 color) {
-    const uint8_t scaled_r = color.r << 2;
-    const uint8_t scaled_g = color.g << 2;
-    const uint8_t scaled_b = color.b << 2;
+static void _slave_entry(void) {
+    frame_slot* const slot = &_frame_slots[_decode_index];
 
-    const color_rgb1555_t rgb1555_color =
-        COLOR_RGB1555(1, scaled_r, scaled_g, scaled_b);
+    /* The master releases a slot only after its command tables have been
+     * transferred, and only notifies once the other slot is ready */
+    while (slot->state != FRAME_SLOT_STATE_FREE) {
+    }
+
+    _frame_decode(slot);
+
+    _decode_index ^= 1;
+}
+
+static void _playback_clock_reset(void) {
+    _playback.vblank_start = _vblank_count -
+        (_playback.frame_count * PLAYBACK_VBLANKS_PER_FRAME);
+}
+
+/* Index of the frame that should be on screen */
+static uint32_t _playback_frame_due(void) {
+    return (_vblank_count - _playback.vblank_start) / PLAYBACK_VBLANKS_PER_FRAME;
+}
+
+static void _palette_merge(const color_rgb1555_t* palette, uint16_t palette_mask) {
+    for (uint32_t i = 0; i < 16; i++) {
+        if ((palette_mask & (1 << i)) != 0) {
+            _palette_buffer[i] = palette[i];
+        }
+    }
+
+    _palette_pending_mask |= palette_mask;
+}
 
-    _palette[palette_index] = rgb1555_color;
+static void _palette_flush(void) {
+    const uint16_t palette_mask = _palette_pending_mask;
 
-    (void)memcpy((void*)VDP2_CRAM_ADDR(0x10), &_palette[0], sizeof(_palette));
+    if (palette_mask == 0x0000) {
+        return;
+    }
+
+    _palette_pending_mask = 0x0000;
+
+    /* Transfer the span of entries that changed, widened to 32-bit
+     * boundaries. The unchanged entries inside the span are rewritten with
+     * what CRAM already holds */
+    const uint32_t first = __builtin_ctz(palette_mask) & ~1;
+    const uint32_t last = (31 - __builtin_clz(palette_mask)) | 1;
+
+    scu_dma_level_cfg_t scu_dma_level_cfg;
+
+    scu_dma_level_cfg.mode = SCU_DMA_MODE_DIRECT;
+    scu_dma_level_cfg.stride = SCU_DMA_STRIDE_2_BYTES;
+    scu_dma_level_cfg.update = SCU_DMA_UPDATE_NONE;
+    scu_dma_level_cfg.xfer.direct.len = ((last - first) + 1) * sizeof(color_rgb1555_t);
+    scu_dma_level_cfg.xfer.direct.dst = VDP2_CRAM_ADDR(0x10 + first);
+    scu_dma_level_cfg.xfer.direct.src = (uint32_t)&_palette_buffer[first];
+
+    scu_dma_handle_t handle;
+
+    scu_dma_config_buffer(&handle, &scu_dma_level_cfg);
+
+    /* Uploading during VBLANK-IN avoids stalling on CRAM access, and
+     * changing colors while the frame is being scanned out */
+    int8_t ret __unused;
+    ret = dma_queue_enqueue(&handle, DMA_QUEUE_TAG_VBLANK_IN, NULL, NULL);
+    assert(ret == 0);
 }
 
-static void _on_clear_screen(bool clear_screen __unused) {
-    if (!clear_screen) {
+static void _baked_init(void) {
+    const uint32_t id = dram_cart_id_get();
+
+    if (id != DRAM_CART_ID_4MIB) {
+        dbgio_puts("SCENE.CMD requires the 32-Mbit\n"
+                   "extended RAM cartridge\n");
+        dbgio_flush();
+        vdp_sync();
+        abort();
+    }
+
+    /* SCENE.CMD is too large for work RAM, so it lives at the start of the
+     * cartridge area. The cartridge keeps it until the power is cut, so it's
+     * only baked from SCENE.BIN when it isn't already there */
+    _baked_file_header =
+        static_cast<const scene_baked::file_header*>(dram_cart_area_get());
+
+    if ((_baked_file_header->magic != scene_baked::magic) ||
+        (_baked_file_header->version != scene_baked::version)) {
+        dbgio_puts("Baking SCENE.CMD...\n");
+        dbgio_flush();
+        vdp_sync();
+
+        void *fh = romdisk_open(_romdisk, _scene_file_path);
+        assert(fh != NULL);
+        const uint8_t* scene_buffer = static_cast<uint8_t*>(romdisk_direct(fh));
+
+        const size_t size = scene_baked::bake(scene_buffer,
+                                              static_cast<uint8_t*>(dram_cart_area_get()),
+                                              dram_cart_size_get());
+
+        romdisk_close(fh);
+
+        if (size == 0) {
+            dbgio_puts("SCENE.CMD doesn't fit in the\n"
+                       "extended RAM cartridge\n");
+            dbgio_flush();
+            vdp_sync();
+            abort();
+        }
+    }
+
+    _baked_frame = reinterpret_cast<const uint8_t*>(&_baked_file_header[1]);
+    _baked_frame_index = 0;
+}
+
+static void _baked_frame_submit(void) {
+    const scene_baked::frame_header* const frame_header =
+        reinterpret_cast<const scene_baked::frame_header*>(_baked_frame);
+
+    if (((frame_header->flags & scene_baked::frame_flag_clear_screen) == 0) &&
+        !_playback.clear_screen) {
         vdp1_sync_mode_set(VDP1_SYNC_MODE_CHANGE_ONLY);
     } else {
         vdp1_sync_mode_set(VDP1_SYNC_MODE_ERASE_CHANGE);
     }
-}
 
-static inline __always_inline void _vertex_set(int16_t& x,
-                                               int16_t& y,
-                                               int16_vec2_t const& vertex) {
-    x = vertex.x;
-    y = vertex.y;
-    // x = fix16_int16_mul(_scale_width, vertex.x) >> 16;
-    // y = fix16_int16_mul(_scale_height, vertex.y) >> 16;
-}
+    _playback.clear_screen = false;
+    _playback.frame_count++;
 
-static void _on_draw_polygon3(int16_vec2_t const * vertex_buffer __unused,
-                              const size_t count __unused,
-                              const uint8_t palette_index __unused) {
-    /* Specify the CRAM offset */
-    vdp1_cmdt_color_bank_t color_bank;
-    color_bank.raw = 0x0000;
-    color_bank.type_0.data.dc = palette_index + 0x10;
+    _palette_merge(reinterpret_cast<const color_rgb1555_t*>(frame_header->palette),
+                   frame_header->palette_mask);
+    _palette_flush();
 
-    vdp1_cmdt* const cmdt =
-        &_scene_cmdt_list->cmdts[ORDER_BUFFER_STARTING_INDEX + _cmdt_buffer_index];
+    dbgio_printf("i: %i, frame_index: %li\n", frame_header->polygon_count, _baked_frame_index);
+
+    /* The command tables are already in the layout VDP1 expects, so they're
+     * transferred straight from the cartridge */
+    _baked_cmdt_list.cmdts =
+        reinterpret_cast<vdp1_cmdt_t*>(const_cast<scene_baked::frame_header*>(&frame_header[1]));
+    _baked_cmdt_list.count = frame_header->cmdt_count;
 
-    vdp1_cmdt_polygon_set(cmdt);
-    vdp1_cmdt_param_color_bank_set(cmdt, color_bank);
+    vdp1_sync_cmdt_list_put(&_baked_cmdt_list, NULL, NULL);
 
-    int16_vec2_t out_v[3];
+    _baked_frame_advance();
+}
 
-    _vertex_set(out_v[0].x, out_v[0].y, vertex_buffer[0]);
-    _vertex_set(out_v[1].x, out_v[1].y, vertex_buffer[1]);
-    _vertex_set(out_v[2].x, out_v[2].y, vertex_buffer[2]);
+static void _baked_frame_skip(void) {
+    const scene_baked::frame_header* const frame_header =
+        reinterpret_cast<const scene_baked::frame_header*>(_baked_frame);
 
-    cmdt->cmd_xa = out_v[0].x;
-    cmdt->cmd_ya = out_v[0].y;
+    _playback.clear_screen |=
+        (frame_header->flags & scene_baked::frame_flag_clear_screen) != 0;
+    _playback.frame_count++;
+    _playback.skipped_count++;
 
-    cmdt->cmd_xb = out_v[1].x;
-    cmdt->cmd_yb = out_v[1].y;
+    _palette_merge(reinterpret_cast<const color_rgb1555_t*>(frame_header->palette),
+                   frame_header->palette_mask);
 
-    cmdt->cmd_xc = out_v[1].x;
-    cmdt->cmd_yc = out_v[1].y;
+    _baked_frame_advance();
+}
 
-    cmdt->cmd_xd = out_v[2].x;
-    cmdt->cmd_yd = out_v[2].y;
+static void _baked_frame_advance(void) {
+    const scene_baked::frame_header* const frame_header =
+        reinterpret_cast<const scene_baked::frame_header*>(_baked_frame);
 
-    _cmdt_buffer_index++;
+    if ((frame_header->flags & scene_baked::frame_flag_last_frame) != 0) {
+        _baked_frame = reinterpret_cast<const uint8_t*>(&_baked_file_header[1]);
+        _baked_frame_index = 0;
+    } else {
+        _baked_frame += sizeof(scene_baked::frame_header) +
+            (frame_header->cmdt_count * scene_baked::cmdt_size);
+        _baked_frame_index++;
+    }
 }
 
-static void _on_draw_polygon4(int16_vec2_t const * vertex_buffer __unused,
-                              size_t count __unused,
-                              uint8_t palette_index __unused) {
-    /* Specify the CRAM offset */
-    vdp1_cmdt_color_bank_t color_bank;
-    color_bank.raw = 0x0000;
-    color_bank.type_0.data.dc = palette_index + 0x10;
+static void _vblank_in_handler(void *) {
+    _vblank_count++;
+}
 
-    vdp1_cmdt* const cmdt =
-        &_scene_cmdt_list->cmdts[ORDER_BUFFER_STARTING_INDEX + _cmdt_buffer_index];
+static void _vblank_out_handler(void *) {
+    smpc_peripheral_intback_issue();
+}
 
-    vdp1_cmdt_polygon_set(cmdt);
-    vdp1_cmdt_param_color_bank_set(cmdt, color_bank);
+static void _on_start(uint32_t, bool) {
+    _emit_slot->palette_mask = 0x0000;
+}
+
+static void _on_end(uint32_t frame_index, bool last_frame) {
+    frame_slot* const slot = _emit_slot;
 
-    _vertex_set(cmdt->cmd_xa, cmdt->cmd_ya, vertex_buffer[0]);
-    _vertex_set(cmdt->cmd_xb, cmdt->cmd_yb, vertex_buffer[1]);
-    _vertex_set(cmdt->cmd_xc, cmdt->cmd_yc, vertex_buffer[2]);
-    _vertex_set(cmdt->cmd_xd, cmdt->cmd_yd, vertex_buffer[3]);
+    /* Only the tables written this frame are submitted. Past them, the
+     * arena still holds the tables of an older frame */
+    const uint16_t end_index = ORDER_BUFFER_STARTING_INDEX + _cmdt_buffer_index;
 
-    _cmdt_buffer_index++;
+    vdp1_cmdt_end_set(&slot->cmdts[end_index]);
+
+    slot->cmdt_count = end_index + 1;
+    slot->cmdt_required = _cmdt_required_count;
+    slot->polygon_count = _cmdt_buffer_index;
+    slot->frame_index = frame_index;
+    slot->last_frame = last_frame;
+
+    if (last_frame) {
+        scene::reset();
+    }
 }
 
-static void _on_draw_polygon5(int16_vec2_t const * vertex_buffer __unused,
-                              size_t count __unused,
-                              uint8_t palette_index __unused) {
-    /* Specify the CRAM offset */
-    vdp1_cmdt_color_bank_t color_bank;
-    color_bank.raw = 0x0000;
-    color_bank.type_0.data.dc = palette_index + 0x10;
+static void _on_update_palette(uint8_t palette_index,
+                               const scene::rgb444 color) {
+    const uint8_t scaled_r = color.r << 2;
+    const uint8_t scaled_g = color.g << 2;
+    const uint8_t scaled_b = color.b << 2;
 
-    vdp1_cmdt* const cmdt =
-        &_scene_cmdt_list->cmdts[ORDER_BUFFER_STARTING_INDEX + _cmdt_buffer_index];
-
-    vdp1_cmdt_polygon_set(&cmdt[0]);
-    vdp1_cmdt_param_color_bank_set(&cmdt[0], color_bank);
-    vdp1_cmdt_polygon_set(&cmdt[1]);
-    vdp1_cmdt_param_color_bank_set(&cmdt[1], color_bank);
-    vdp1_cmdt_polygon_set(&cmdt[2]);
-    vdp1_cmdt_param_color_bank_set(&cmdt[2], color_bank);
-
-    int16_vec2_t out_v[5];
-
-    _vertex_set(out_v[0].x, out_v[0].y, vertex_buffer[0]);
-    _vertex_set(out_v[1].x, out_v[1].y, vertex_buffer[1]);
-    _vertex_set(out_v[2].x, out_v[2].y, vertex_buffer[2]);
-    _vertex_set(out_v[3].x, out_v[3].y, vertex_buffer[3]);
-    _vertex_set(out_v[4].x, out_v[4].y, vertex_buffer[4]);
-
-    // vertex_buffer[0]
-    // vertex_buffer[1]
-    // vertex_buffer[1]
-    // vertex_buffer[2]
-    cmdt[0].cmd_xa = out_v[0].x;
-    cmdt[0].cmd_ya = out_v[0].y;
-    cmdt[0].cmd_xb = out_v[1].x;
-    cmdt[0].cmd_yb = out_v[1].y;
-    cmdt[0].cmd_xc = out_v[1].x;
-    cmdt[0].cmd_yc = out_v[1].y;
-    cmdt[0].cmd_xd = out_v[2].x;
-    cmdt[0].cmd_yd = out_v[2].y;
-
-    // vertex_buffer[0]
-    // vertex_buffer[2]
-    // vertex_buffer[2]
-    // vertex_buffer[3]
-    cmdt[1].cmd_xa = out_v[0].x;
-    cmdt[1].cmd_ya = out_v[0].y;
-    cmdt[1].cmd_xb = out_v[2].x;
-    cmdt[1].cmd_yb = out_v[2].y;
-    cmdt[1].cmd_xc = out_v[2].x;
-    cmdt[1].cmd_yc = out_v[2].y;
-    cmdt[1].cmd_xd = out_v[3].x;
-    cmdt[1].cmd_yd = out_v[3].y;
-
-    // vertex_buffer[0]
-    // vertex_buffer[3]
-    // vertex_buffer[3]
-    // vertex_buffer[4]
-    cmdt[2].cmd_xa = out_v[0].x;
-    cmdt[2].cmd_ya = out_v[0].y;
-    cmdt[2].cmd_xb = out_v[3].x;
-    cmdt[2].cmd_yb = out_v[3].y;
-    cmdt[2].cmd_xc = out_v[3].x;
-    cmdt[2].cmd_yc = out_v[3].y;
-    cmdt[2].cmd_xd = out_v[4].x;
-    cmdt[2].cmd_yd = out_v[4].y;
-
-    _cmdt_buffer_index += 3;
+    const color_rgb1555_t rgb1555_color =
+        COLOR_RGB1555(1, scaled_r, scaled_g, scaled_b);
+
+    _emit_slot->palette[palette_index] = rgb1555_color;
+    _emit_slot->palette_mask |= 1 << palette_index;
 }
 
-static void _on_draw_polygon6(int16_vec2_t const * vertex_buffer __unused,
-                              size_t count __unused,
-                              uint8_t palette_index __unused) {
-    /* Specify the CRAM offset */
-    vdp1_cmdt_color_bank_t color_bank;
-    color_bank.raw = 0x0000;
-    color_bank.type_0.data.dc = palette_index + 0x10;
+static void _on_clear_screen(bool clear_screen) {
+    _emit_slot->clear_screen = clear_screen;
+}
 
-    vdp1_cmdt* const cmdt =
-        &_scene_cmdt_list->cmdts[ORDER_BUFFER_STARTING_INDEX + _cmdt_buffer_index];
-
-    vdp1_cmdt_polygon_set(&cmdt[0]);
-    vdp1_cmdt_param_color_bank_set(&cmdt[0], color_bank);
-    vdp1_cmdt_polygon_set(&cmdt[1]);
-    vdp1_cmdt_param_color_bank_set(&cmdt[1], color_bank);
-    vdp1_cmdt_polygon_set(&cmdt[2]);
-    vdp1_cmdt_param_color_bank_set(&cmdt[2], color_bank);
-    vdp1_cmdt_polygon_set(&cmdt[3]);
-    vdp1_cmdt_param_color_bank_set(&cmdt[3], color_bank);
-
-    int16_vec2_t out_v[6];
-
-    _vertex_set(out_v[0].x, out_v[0].y, vertex_buffer[0]);
-    _vertex_set(out_v[1].x, out_v[1].y, vertex_buffer[1]);
-    _vertex_set(out_v[2].x, out_v[2].y, vertex_buffer[2]);
-    _vertex_set(out_v[3].x, out_v[3].y, vertex_buffer[3]);
-    _vertex_set(out_v[4].x, out_v[4].y, vertex_buffer[4]);
-    _vertex_set(out_v[5].x, out_v[5].y, vertex_buffer[5]);
-
-    // vertex_buffer[0]
-    // vertex_buffer[1]
-    // vertex_buffer[1]
-    // vertex_buffer[2]
-    cmdt[0].cmd_xa = out_v[0].x;
-    cmdt[0].cmd_ya = out_v[0].y;
-    cmdt[0].cmd_xb = out_v[1].x;
-    cmdt[0].cmd_yb = out_v[1].y;
-    cmdt[0].cmd_xc = out_v[1].x;
-    cmdt[0].cmd_yc = out_v[1].y;
-    cmdt[0].cmd_xd = out_v[2].x;
-    cmdt[0].cmd_yd = out_v[2].y;
-
-    // vertex_buffer[0]
-    // vertex_buffer[2]
-    // vertex_buffer[2]
-    // vertex_buffer[3]
-    cmdt[1].cmd_xa = out_v[0].x;
-    cmdt[1].cmd_ya = out_v[0].y;
-    cmdt[1].cmd_xb = out_v[2].x;
-    cmdt[1].cmd_yb = out_v[2].y;
-    cmdt[1].cmd_xc = out_v[2].x;
-    cmdt[1].cmd_yc = out_v[2].y;
-    cmdt[1].cmd_xd = out_v[3].x;
-    cmdt[1].cmd_yd = out_v[3].y;
-
-    // vertex_buffer[0]
-    // vertex_buffer[3]
-    // vertex_buffer[3]
-    // vertex_buffer[4]
-    cmdt[2].cmd_xa = out_v[0].x;
-    cmdt[2].cmd_ya = out_v[0].y;
-    cmdt[2].cmd_xb = out_v[3].x;
-    cmdt[2].cmd_yb = out_v[3].y;
-    cmdt[2].cmd_xc = out_v[3].x;
-    cmdt[2].cmd_yc = out_v[3].y;
-    cmdt[2].cmd_xd = out_v[4].x;
-    cmdt[2].cmd_yd = out_v[4].y;
-
-    // vertex_buffer[0]
-    // vertex_buffer[4]
-    // vertex_buffer[4]
-    // vertex_buffer[5]
-    cmdt[3].cmd_xa = out_v[0].x;
-    cmdt[3].cmd_ya = out_v[0].y;
-    cmdt[3].cmd_xb = out_v[4].x;
-    cmdt[3].cmd_yb = out_v[4].y;
-    cmdt[3].cmd_xc = out_v[4].x;
-    cmdt[3].cmd_yc = out_v[4].y;
-    cmdt[3].cmd_xd = out_v[5].x;
-    cmdt[3].cmd_yd = out_v[5].y;
-
-    _cmdt_buffer_index += 4;
+static inline __always_inline void _vertex_set(int16_t& x,
+                                               int16_t& y,
+                                               int16_vec2_t const& vertex) {
+    x = vertex.x;
+    y = vertex.y;
+    // x = fix16_int16_mul(_scale_width, vertex.x) >> 16;
+    // y = fix16_int16_mul(_scale_height, vertex.y) >> 16;
 }
 
-static void _on_draw_polygon7(int16_vec2_t const * vertex_buffer __unused,
-                              size_t count __unused,
-                              uint8_t palette_index __unused) {
+/* Covers a convex N-gon with a fan of ceil((N - 2) / 2) quads, each one
+ * taking two triangles of the fan (V0, Vi, Vi+1, Vi+2). When N is odd, the
+ * last quad only covers one triangle and repeats its last vertex */
+template <size_t N>
+static void _on_draw_polygon(int16_vec2_t const * vertex_buffer,
+                             const size_t count __unused,
+                             const uint8_t palette_index) {
+    static_assert((N >= 3) && (N <= 15));
+
+    constexpr size_t quad_count = (N - 1) / 2;
+
     /* Specify the CRAM offset */
     vdp1_cmdt_color_bank_t color_bank;
     color_bank.raw = 0x0000;
     color_bank.type_0.data.dc = palette_index + 0x10;
 
+    _cmdt_required_count += quad_count;
+
+    /* Drop the polygon if it doesn't fit. The master grows the arena once
+     * the frame has been submitted */
+    if ((_cmdt_buffer_index + quad_count) > _emit_slot->cmdt_capacity) {
+        return;
+    }
+
+    const uint32_t cmdt_index = _cmdt_buffer_index;
+
+    _cmdt_buffer_index += quad_count;
+
     vdp1_cmdt* const cmdt =
-        &_scene_cmdt_list->cmdts[ORDER_BUFFER_STARTING_INDEX + _cmdt_buffer_index];
-
-    vdp1_cmdt_polygon_set(&cmdt[0]);
-    vdp1_cmdt_param_color_bank_set(&cmdt[0], color_bank);
-    vdp1_cmdt_polygon_set(&cmdt[1]);
-    vdp1_cmdt_param_color_bank_set(&cmdt[1], color_bank);
-    vdp1_cmdt_polygon_set(&cmdt[2]);
-    vdp1_cmdt_param_color_bank_set(&cmdt[2], color_bank);
-    vdp1_cmdt_polygon_set(&cmdt[3]);
-    vdp1_cmdt_param_color_bank_set(&cmdt[3], color_bank);
-    vdp1_cmdt_polygon_set(&cmdt[4]);
-    vdp1_cmdt_param_color_bank_set(&cmdt[4], color_bank);
-    vdp1_cmdt_polygon_set(&cmdt[5]);
-    vdp1_cmdt_param_color_bank_set(&cmdt[5], color_bank);
-    vdp1_cmdt_polygon_set(&cmdt[6]);
-    vdp1_cmdt_param_color_bank_set(&cmdt[6], color_bank);
-
-    int16_vec2_t out_v[7];
-
-    _vertex_set(out_v[0].x, out_v[0].y, vertex_buffer[0]);
-    _vertex_set(out_v[1].x, out_v[1].y, vertex_buffer[1]);
-    _vertex_set(out_v[2].x, out_v[2].y, vertex_buffer[2]);
-    _vertex_set(out_v[3].x, out_v[3].y, vertex_buffer[3]);
-    _vertex_set(out_v[4].x, out_v[4].y, vertex_buffer[4]);
-    _vertex_set(out_v[5].x, out_v[5].y, vertex_buffer[5]);
-    _vertex_set(out_v[6].x, out_v[6].y, vertex_buffer[6]);
-
-    // vertex_buffer[0]
-    // vertex_buffer[1]
-    // vertex_buffer[1]
-    // vertex_buffer[2]
-    cmdt[0].cmd_xa = out_v[0].x;
-    cmdt[0].cmd_ya = out_v[0].y;
-    cmdt[0].cmd_xb = out_v[1].x;
-    cmdt[0].cmd_yb = out_v[1].y;
-    cmdt[0].cmd_xc = out_v[1].x;
-    cmdt[0].cmd_yc = out_v[1].y;
-    cmdt[0].cmd_xd = out_v[2].x;
-    cmdt[0].cmd_yd = out_v[2].y;
-
-    // vertex_buffer[0]
-    // vertex_buffer[2]
-    // vertex_buffer[2]
-    // vertex_buffer[3]
-    cmdt[1].cmd_xa = out_v[0].x;
-    cmdt[1].cmd_ya = out_v[0].y;
-    cmdt[1].cmd_xb = out_v[2].x;
-    cmdt[1].cmd_yb = out_v[2].y;
-    cmdt[1].cmd_xc = out_v[2].x;
-    cmdt[1].cmd_yc = out_v[2].y;
-    cmdt[1].cmd_xd = out_v[3].x;
-    cmdt[1].cmd_yd = out_v[3].y;
-
-    // vertex_buffer[0]
-    // vertex_buffer[3]
-    // vertex_buffer[3]
-    // vertex_buffer[4]
-    cmdt[2].cmd_xa = out_v[0].x;
-    cmdt[2].cmd_ya = out_v[0].y;
-    cmdt[2].cmd_xb = out_v[3].x;
-    cmdt[2].cmd_yb = out_v[3].y;
-    cmdt[2].cmd_xc = out_v[3].x;
-    cmdt[2].cmd_yc = out_v[3].y;
-    cmdt[2].cmd_xd = out_v[4].x;
-    cmdt[2].cmd_yd = out_v[4].y;
-
-    // vertex_buffer[0]
-    // vertex_buffer[4]
-    // vertex_buffer[4]
-    // vertex_buffer[5]
-    cmdt[3].cmd_xa = out_v[0].x;
-    cmdt[3].cmd_ya = out_v[0].y;
-    cmdt[3].cmd_xb = out_v[4].x;
-    cmdt[3].cmd_yb = out_v[4].y;
-    cmdt[3].cmd_xc = out_v[4].x;
-    cmdt[3].cmd_yc = out_v[4].y;
-    cmdt[3].cmd_xd = out_v[5].x;
-    cmdt[3].cmd_yd = out_v[5].y;
-
-    // vertex_buffer[0]
-    // vertex_buffer[5]
-    // vertex_buffer[5]
-    // vertex_buffer[6]
-    cmdt[4].cmd_xa = out_v[0].x;
-    cmdt[4].cmd_ya = out_v[0].y;
-    cmdt[4].cmd_xb = out_v[5].x;
-    cmdt[4].cmd_yb = out_v[5].y;
-    cmdt[4].cmd_xc = out_v[5].x;
-    cmdt[4].cmd_yc = out_v[5].y;
-    cmdt[4].cmd_xd = out_v[6].x;
-    cmdt[4].cmd_yd = out_v[6].y;
-
-    _cmdt_buffer_index += 5;
+        &_emit_slot->cmdts[ORDER_BUFFER_STARTING_INDEX + cmdt_index];
+
+    int16_vec2_t out_v[N];
+
+    for (size_t i = 0; i < N; i++) {
+        _vertex_set(out_v[i].x, out_v[i].y, vertex_buffer[i]);
+    }
+
+    for (size_t quad = 0; quad < quad_count; quad++) {
+        const size_t b = (quad * 2) + 1;
+        const size_t d = ((b + 2) < N) ? (b + 2) : (b + 1);
+
+        vdp1_cmdt_polygon_set(&cmdt[quad]);
+        vdp1_cmdt_param_color_bank_set(&cmdt[quad], color_bank);
+
+        cmdt[quad].cmd_xa = out_v[0].x;
+        cmdt[quad].cmd_ya = out_v[0].y;
+        cmdt[quad].cmd_xb = out_v[b].x;
+        cmdt[quad].cmd_yb = out_v[b].y;
+        cmdt[quad].cmd_xc = out_v[b + 1].x;
+        cmdt[quad].cmd_yc = out_v[b + 1].y;
+        cmdt[quad].cmd_xd = out_v[d].x;
+        cmdt[quad].cmd_yd = out_v[d].y;
+    }
 }
 
 static void _on_draw(int16_vec2_t const * vertex_buffer,
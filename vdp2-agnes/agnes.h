@@ -60,6 +60,11 @@ typedef struct {
 
 typedef struct agnes agnes_t;
 typedef struct agnes_state agnes_state_t;
+typedef struct agnes_ppu_bridge agnes_ppu_bridge_t;
+
+/* Called by the PPU as soon as a visible line has been rendered. line points
+ * to the line's AGNES_SCREEN_WIDTH palette indices in the screen buffer */
+typedef void (*agnes_scanline_callback_t)(int scanline, const uint8_t *line, void *work);
 
 agnes_t* agnes_make(void);
 void agnes_destroy(agnes_t *agn);
@@ -70,9 +75,16 @@ void agnes_dump_state(const agnes_t *agnes, agnes_state_t *out_res);
 bool agnes_restore_state(agnes_t *agnes, const agnes_state_t *state);
 bool agnes_tick(agnes_t *agnes, bool *out_new_frame);
 bool agnes_next_frame(agnes_t *agnes);
+void agnes_set_scanline_callback(agnes_t *agnes, agnes_scanline_callback_t callback, void *work);
+void agnes_set_ppu_bridge(agnes_t *agnes, const agnes_ppu_bridge_t *bridge, void *work);
 
 agnes_color_t agnes_get_screen_pixel(const agnes_t *agnes, int x, int y);
 
+/* Row-major AGNES_SCREEN_WIDTH x AGNES_SCREEN_HEIGHT palette indices. Only the
+ * low 6 bits of each index are significant */
+const uint8_t* agnes_get_screen_buffer(const agnes_t *agnes);
+agnes_color_t agnes_get_palette_color(uint8_t color_ix);
+
 #ifdef __cplusplus
 }
 #endif
@@ -122,6 +134,21 @@ typedef enum {
     INTERRUPT_IRQ = 2
 } cpu_interrupt_t;
 
+struct cpu;
+
+typedef uint8_t (*cpu_read_handler_t)(struct cpu *cpu, uint16_t addr);
+typedef void (*cpu_write_handler_t)(struct cpu *cpu, uint16_t addr, uint8_t val);
+
+// One 256-byte page of the CPU address space. Pages backed by memory point
+// straight at it, the rest (PPU registers, I/O, mapper registers) leave the
+// pointer NULL and go through the handler
+typedef struct cpu_page {
+    const uint8_t *read;
+    uint8_t *write;
+    cpu_read_handler_t read_handler;
+    cpu_write_handler_t write_handler;
+} cpu_page_t;
+
 typedef struct cpu {
     struct agnes *agnes;
     uint16_t pc;
@@ -138,6 +165,7 @@ typedef struct cpu {
     uint32_t stall;
     uint64_t cycles;
     cpu_interrupt_t interrupt;
+    cpu_page_t pages[256];
 } cpu_t;
 
 /************************************ PPU ************************************/
@@ -207,6 +235,10 @@ typedef struct ppu {
     sprite_t sprites[8];
     int sprite_ixs[8];
     int sprite_ixs_count;
+
+    // Dots of the current line ppu_run() is holding back until the whole
+    // line is due (AGNES_SCANLINE_RENDERER only)
+    int deferred_dots;
 } ppu_t;
 
 /********************************** MAPPERS **********************************/
@@ -288,6 +320,21 @@ typedef struct controller {
     uint8_t shift;
 } controller_t;
 
+/******************************** PPU BRIDGE *********************************/
+
+// Runs the PPU somewhere other than inline with the CPU. The CPU side calls
+// advance(), read_register(), write_register() and write_mapper() in place of
+// driving the PPU and the mapper's registers directly. The PPU side raises its
+// interrupts through trigger_nmi() and trigger_irq()
+typedef struct agnes_ppu_bridge {
+    void (*advance)(agnes_t *agnes, int ppu_cycles, bool *out_new_frame, void *work);
+    uint8_t (*read_register)(agnes_t *agnes, uint16_t addr, void *work);
+    void (*write_register)(agnes_t *agnes, uint16_t addr, uint8_t val, void *work);
+    void (*write_mapper)(agnes_t *agnes, uint16_t addr, uint8_t val, void *work);
+    void (*trigger_nmi)(agnes_t *agnes, void *work);
+    void (*trigger_irq)(agnes_t *agnes, void *work);
+} agnes_ppu_bridge_t;
+
 /*********************************** AGNES ***********************************/
 typedef struct agnes {
     cpu_t cpu;
@@ -305,6 +352,12 @@ typedef struct agnes {
     } mapper;
 
     mirroring_mode_t mirroring_mode;
+
+    agnes_scanline_callback_t scanline_callback;
+    void *scanline_callback_work;
+
+    const agnes_ppu_bridge_t *ppu_bridge;
+    void *ppu_bridge_work;
 } agnes_t;
 
 #endif /* agnes_types_h */
@@ -321,6 +374,7 @@ typedef struct agnes agnes_t;
 typedef struct cpu cpu_t;
 
 AGNES_INTERNAL void cpu_init(cpu_t *cpu, agnes_t *agnes);
+AGNES_INTERNAL void cpu_map_pages(cpu_t *cpu);
 AGNES_INTERNAL int cpu_tick(cpu_t *cpu);
 AGNES_INTERNAL void cpu_update_zn_flags(cpu_t *cpu, uint8_t val);
 AGNES_INTERNAL void cpu_stack_push8(cpu_t *cpu, uint8_t val);
@@ -353,6 +407,11 @@ AGNES_INTERNAL void ppu_init(ppu_t *ppu, agnes_t *agnes);
 AGNES_INTERNAL void ppu_tick(ppu_t *ppu, bool *out_new_frame);
 AGNES_INTERNAL uint8_t ppu_read_register(ppu_t *ppu, uint16_t reg);
 AGNES_INTERNAL void ppu_write_register(ppu_t *ppu, uint16_t addr, uint8_t val);
+AGNES_INTERNAL void ppu_write_oam_dma(ppu_t *ppu, uint8_t val);
+#ifdef AGNES_SCANLINE_RENDERER
+AGNES_INTERNAL void ppu_run(ppu_t *ppu, int dots, bool *out_new_frame);
+AGNES_INTERNAL void ppu_sync(ppu_t *ppu);
+#endif
 
 #endif /* ppu_h */
 //FILE_END
@@ -413,7 +472,11 @@ typedef struct agnes agnes_t;
 AGNES_INTERNAL bool mapper_init(agnes_t *agnes);
 AGNES_INTERNAL uint8_t mapper_read(agnes_t *agnes, uint16_t addr);
 AGNES_INTERNAL void mapper_write(agnes_t *agnes, uint16_t addr, uint8_t val);
+AGNES_INTERNAL void mapper_map_prg(agnes_t *agnes);
 AGNES_INTERNAL void mapper_pa12_rising_edge(agnes_t *agnes);
+#ifdef AGNES_SCANLINE_RENDERER
+AGNES_INTERNAL bool mapper_scanline_irq_enabled(agnes_t *agnes);
+#endif
 
 #endif /* mapper_h */
 //FILE_END
@@ -614,6 +677,7 @@ void agnes_dump_state(const agnes_t *agnes, agnes_state_t *out_res) {
     out_res->agnes.gamepack.data = NULL;
     out_res->agnes.cpu.agnes = NULL;
     out_res->agnes.ppu.agnes = NULL;
+    memset(out_res->agnes.cpu.pages, 0, sizeof(out_res->agnes.cpu.pages));
     switch (out_res->agnes.gamepack.mapper) {
         case 0: out_res->agnes.mapper.m0.agnes = NULL; break;
         case 1: out_res->agnes.mapper.m1.agnes = NULL; break;
@@ -634,6 +698,7 @@ bool agnes_restore_state(agnes_t *agnes, const agnes_state_t *state) {
         case 2: agnes->mapper.m2.agnes = agnes; break;
         case 4: agnes->mapper.m4.agnes = agnes; break;
     }
+    cpu_map_pages(&agnes->cpu);
     return true;
 }
 
@@ -644,9 +709,17 @@ bool agnes_tick(agnes_t *agnes, bool *out_new_frame) {
     }
 
     int ppu_cycles = cpu_cycles * 3;
+    if (agnes->ppu_bridge != NULL) {
+        agnes->ppu_bridge->advance(agnes, ppu_cycles, out_new_frame, agnes->ppu_bridge_work);
+        return true;
+    }
+#ifdef AGNES_SCANLINE_RENDERER
+    ppu_run(&agnes->ppu, ppu_cycles, out_new_frame);
+#else
     for (int i = 0; i < ppu_cycles; i++) {
         ppu_tick(&agnes->ppu, out_new_frame);
     }
+#endif
     
     return true;
 }
@@ -665,12 +738,31 @@ bool agnes_next_frame(agnes_t *agnes) {
     return true;
 }
 
+void agnes_set_scanline_callback(agnes_t *agnes, agnes_scanline_callback_t callback, void *work) {
+    agnes->scanline_callback = callback;
+    agnes->scanline_callback_work = work;
+}
+
+// Must be set before the first frame is emulated
+void agnes_set_ppu_bridge(agnes_t *agnes, const agnes_ppu_bridge_t *bridge, void *work) {
+    agnes->ppu_bridge = bridge;
+    agnes->ppu_bridge_work = work;
+}
+
 agnes_color_t agnes_get_screen_pixel(const agnes_t *agnes, int x, int y) {
     int ix = (y * AGNES_SCREEN_WIDTH) + x;
     uint8_t color_ix = agnes->ppu.screen_buffer[ix];
     return g_colors[color_ix & 0x3f];
 }
 
+const uint8_t* agnes_get_screen_buffer(const agnes_t *agnes) {
+    return agnes->ppu.screen_buffer;
+}
+
+agnes_color_t agnes_get_palette_color(uint8_t color_ix) {
+    return g_colors[color_ix & 0x3f];
+}
+
 void agnes_destroy(agnes_t *agnes) {
     free(agnes);
 }
@@ -702,13 +794,22 @@ static uint8_t get_input_byte(const agnes_input_t* input) {
 #endif
 
 static uint16_t cpu_read16_indirect_bug(cpu_t *cpu, uint16_t addr);
+static uint8_t cpu_read_ppu_page(cpu_t *cpu, uint16_t addr);
+static void cpu_write_ppu_page(cpu_t *cpu, uint16_t addr, uint8_t val);
+static uint8_t cpu_read_io_page(cpu_t *cpu, uint16_t addr);
+static void cpu_write_io_page(cpu_t *cpu, uint16_t addr, uint8_t val);
+static uint8_t cpu_read_mapper_page(cpu_t *cpu, uint16_t addr);
+static void cpu_write_mapper_page(cpu_t *cpu, uint16_t addr, uint8_t val);
 static uint16_t get_instruction_operand(cpu_t *cpu, addr_mode_t mode, bool *out_pages_differ);
 static int handle_interrupt(cpu_t *cpu);
 static bool check_pages_differ(uint16_t a, uint16_t b);
+static uint8_t cpu_read_ppu_register(agnes_t *agnes, uint16_t addr);
+static void cpu_write_ppu_register(agnes_t *agnes, uint16_t addr, uint8_t val);
 
 void cpu_init(cpu_t *cpu, agnes_t *agnes) {
     memset(cpu, 0, sizeof(cpu_t));
     cpu->agnes = agnes;
+    cpu_map_pages(cpu);
     cpu->pc = cpu_read16(cpu, 0xfffc); // RESET
     cpu->sp = 0xfd;
     cpu_restore_flags(cpu, 0x24);
@@ -814,40 +915,91 @@ void cpu_set_dma_stall(cpu_t *cpu) {
     cpu->stall = (cpu->cycles & 0x1) ? 514 : 513;
 }
 
-void cpu_write8(cpu_t *cpu, uint16_t addr, uint8_t val) {
+void cpu_map_pages(cpu_t *cpu) {
     agnes_t *agnes = cpu->agnes;
 
-    if (addr < 0x2000) {
-        agnes->ram[addr & 0x7ff] = val;
-    } else if (addr < 0x4000) {
-        ppu_write_register(&agnes->ppu, 0x2000 | (addr & 0x7), val);
-    } else if (addr == 0x4014) {
-        ppu_write_register(&agnes->ppu, 0x4014, val);
-    } else if (addr == 0x4016) {
-        agnes->controllers_latch = val & 0x1;
-        if (agnes->controllers_latch) {
-            agnes->controllers[0].shift = agnes->controllers[0].state;
-            agnes->controllers[1].shift = agnes->controllers[1].state;
+    for (int i = 0; i < 256; i++) {
+        cpu_page_t *page = &cpu->pages[i];
+        page->read = NULL;
+        page->write = NULL;
+        if (i < 0x20) { // 2KB of ram, mirrored up to 0x1fff
+            page->write = &agnes->ram[(i & 0x7) << 8];
+            page->read = page->write;
+            page->read_handler = NULL;
+            page->write_handler = NULL;
+        } else if (i < 0x40) {
+            page->read_handler = cpu_read_ppu_page;
+            page->write_handler = cpu_write_ppu_page;
+        } else if (i == 0x40) {
+            page->read_handler = cpu_read_io_page;
+            page->write_handler = cpu_write_io_page;
+        } else {
+            page->read_handler = cpu_read_mapper_page;
+            page->write_handler = cpu_write_mapper_page;
         }
-    } else if (addr < 0x4018) { // apu and io
+    }
 
-    } else if (addr < 0x4020) { // disabled
+    mapper_map_prg(agnes);
+}
 
+void cpu_write8(cpu_t *cpu, uint16_t addr, uint8_t val) {
+    const cpu_page_t *page = &cpu->pages[addr >> 8];
+    if (page->write != NULL) {
+        page->write[addr & 0xff] = val;
     } else {
-        mapper_write(agnes, addr, val);
+        page->write_handler(cpu, addr, val);
     }
 }
 
 uint8_t cpu_read8(cpu_t *cpu, uint16_t addr) {
+    const cpu_page_t *page = &cpu->pages[addr >> 8];
+    if (page->read != NULL) {
+        return page->read[addr & 0xff];
+    }
+    return page->read_handler(cpu, addr);
+}
+
+uint16_t cpu_read16(cpu_t *cpu, uint16_t addr) {
+    uint8_t lo = cpu_read8(cpu, addr);
+    uint8_t hi = cpu_read8(cpu, addr + 1);
+    return (hi << 8) | lo;
+}
+
+static uint8_t cpu_read_ppu_register(agnes_t *agnes, uint16_t addr) {
+    if (agnes->ppu_bridge != NULL) {
+        return agnes->ppu_bridge->read_register(agnes, addr, agnes->ppu_bridge_work);
+    }
+#ifdef AGNES_SCANLINE_RENDERER
+    ppu_sync(&agnes->ppu);
+#endif
+    return ppu_read_register(&agnes->ppu, addr);
+}
+
+static void cpu_write_ppu_register(agnes_t *agnes, uint16_t addr, uint8_t val) {
+    if (agnes->ppu_bridge != NULL) {
+        agnes->ppu_bridge->write_register(agnes, addr, val, agnes->ppu_bridge_work);
+    } else {
+#ifdef AGNES_SCANLINE_RENDERER
+        ppu_sync(&agnes->ppu);
+#endif
+        ppu_write_register(&agnes->ppu, addr, val);
+    }
+}
+
+static uint8_t cpu_read_ppu_page(cpu_t *cpu, uint16_t addr) {
+    return cpu_read_ppu_register(cpu->agnes, 0x2000 | (addr & 0x7));
+}
+
+static void cpu_write_ppu_page(cpu_t *cpu, uint16_t addr, uint8_t val) {
+    cpu_write_ppu_register(cpu->agnes, 0x2000 | (addr & 0x7), val);
+}
+
+static uint8_t cpu_read_io_page(cpu_t *cpu, uint16_t addr) {
     agnes_t *agnes = cpu->agnes;
 
     uint8_t res = 0;
-    if (addr >= 0x4020) { // moved to top because it's the most common case
-        res = mapper_read(agnes, addr);
-    } else if (addr < 0x2000) {
-        res = agnes->ram[addr & 0x7ff];
-    } else if (addr < 0x4000) {
-        res = ppu_read_register(&agnes->ppu, 0x2000 | (addr & 0x7));
+    if (addr >= 0x4020) {
+        res = cpu_read_mapper_page(cpu, addr);
     } else if (addr < 0x4016) {
         // apu
     } else if (addr < 0x4018) {
@@ -861,10 +1013,43 @@ uint8_t cpu_read8(cpu_t *cpu, uint16_t addr) {
     return res;
 }
 
-uint16_t cpu_read16(cpu_t *cpu, uint16_t addr) {
-    uint8_t lo = cpu_read8(cpu, addr);
-    uint8_t hi = cpu_read8(cpu, addr + 1);
-    return (hi << 8) | lo;
+static void cpu_write_io_page(cpu_t *cpu, uint16_t addr, uint8_t val) {
+    agnes_t *agnes = cpu->agnes;
+
+    if (addr == 0x4014) {
+        cpu_write_ppu_register(agnes, 0x4014, val);
+    } else if (addr == 0x4016) {
+        agnes->controllers_latch = val & 0x1;
+        if (agnes->controllers_latch) {
+            agnes->controllers[0].shift = agnes->controllers[0].state;
+            agnes->controllers[1].shift = agnes->controllers[1].state;
+        }
+    } else if (addr < 0x4018) { // apu and io
+
+    } else if (addr < 0x4020) { // disabled
+
+    } else {
+        cpu_write_mapper_page(cpu, addr, val);
+    }
+}
+
+static uint8_t cpu_read_mapper_page(cpu_t *cpu, uint16_t addr) {
+    return mapper_read(cpu->agnes, addr);
+}
+
+static void cpu_write_mapper_page(cpu_t *cpu, uint16_t addr, uint8_t val) {
+    agnes_t *agnes = cpu->agnes;
+
+    if (agnes->ppu_bridge != NULL) {
+        agnes->ppu_bridge->write_mapper(agnes, addr, val, agnes->ppu_bridge_work);
+    } else {
+#ifdef AGNES_SCANLINE_RENDERER
+        if (addr >= 0x8000) { // bank switches change what the PPU fetches
+            ppu_sync(&agnes->ppu);
+        }
+#endif
+        mapper_write(agnes, addr, val);
+    }
 }
 
 static uint16_t cpu_read16_indirect_bug(cpu_t *cpu, uint16_t addr) {
@@ -978,6 +1163,12 @@ static void set_pixel_color_ix(ppu_t *ppu, int x, int y, uint8_t color_ix);
 static uint8_t ppu_read8(ppu_t *ppu, uint16_t addr);
 static void ppu_write8(ppu_t *ppu, uint16_t addr, uint8_t val);
 static uint16_t mirror_address(ppu_t *ppu, uint16_t addr);
+#ifdef AGNES_SCANLINE_RENDERER
+static bool scanline_batchable(ppu_t *ppu);
+static void render_scanline(ppu_t *ppu);
+static void fetch_tile(ppu_t *ppu);
+static void build_sprite_line(ppu_t *ppu, uint8_t *sprite_line);
+#endif
 
 static unsigned g_palette_addr_map[32] = {
     0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f,
@@ -1026,6 +1217,12 @@ void ppu_tick(ppu_t *ppu, bool *out_new_frame) {
         scanline_visible_pre(ppu, out_new_frame);
     }
 
+    // The last pixel of the line was emitted at dot 256
+    if (scanline_visible && ppu->dot == 256 && ppu->agnes->scanline_callback != NULL) {
+        const uint8_t *line = &ppu->screen_buffer[ppu->scanline * AGNES_SCREEN_WIDTH];
+        ppu->agnes->scanline_callback(ppu->scanline, line, ppu->agnes->scanline_callback_work);
+    }
+
     if (ppu->dot == 1) {
         if (scanline_pre) {
             ppu->status.sprite_overflow = false;
@@ -1035,7 +1232,12 @@ void ppu_tick(ppu_t *ppu, bool *out_new_frame) {
             ppu->status.in_vblank = true;
             *out_new_frame = true;
             if (ppu->ctrl.nmi_enabled) {
-                cpu_trigger_nmi(&ppu->agnes->cpu);
+                agnes_t *agnes = ppu->agnes;
+                if (agnes->ppu_bridge != NULL) {
+                    agnes->ppu_bridge->trigger_nmi(agnes, agnes->ppu_bridge_work);
+                } else {
+                    cpu_trigger_nmi(&agnes->cpu);
+                }
             }
         }
     }
@@ -1312,6 +1514,250 @@ static uint16_t get_sprite_color_addr(ppu_t *ppu, int *out_sprite_ix, bool *out_
     return 0;
 }
 
+#ifdef AGNES_SCANLINE_RENDERER
+// Dots 1 to 340 of a visible line, all run at once by render_scanline()
+#define SCANLINE_BATCH_DOTS 340
+
+// Sprite line buffer entries: the low 5 bits of the color address, or 0 when
+// no sprite is opaque at that pixel
+#define SPRITE_LINE_BEHIND_BG 0x20
+#define SPRITE_LINE_SPRITE_ZERO 0x40
+
+// Same as calling ppu_tick() dots times, except that visible lines are
+// rendered whole. What's left of a visible line is held back until the rest
+// of the line is due, so the CPU has to call ppu_sync() before accessing the
+// PPU or switching banks
+void ppu_run(ppu_t *ppu, int dots, bool *out_new_frame) {
+    dots += ppu->deferred_dots;
+
+    while (dots > 0) {
+        if (scanline_batchable(ppu)) {
+            if (dots < SCANLINE_BATCH_DOTS) {
+                break;
+            }
+            render_scanline(ppu);
+            dots -= SCANLINE_BATCH_DOTS;
+        } else {
+            ppu_tick(ppu, out_new_frame);
+            dots--;
+        }
+    }
+
+    ppu->deferred_dots = dots;
+}
+
+// Catches up on the held back dots with the dot-accurate path. They never
+// reach VBLANK, so there's no new frame to report
+void ppu_sync(ppu_t *ppu) {
+    bool new_frame = false;
+
+    for (; ppu->deferred_dots > 0; ppu->deferred_dots--) {
+        ppu_tick(ppu, &new_frame);
+    }
+}
+
+static bool scanline_batchable(ppu_t *ppu) {
+    if (ppu->dot != 0 || ppu->scanline >= 240) {
+        return false;
+    }
+    if (!ppu->masks.show_background && !ppu->masks.show_sprites) {
+        return false;
+    }
+    // The IRQ has to reach the CPU on the dot it's raised at
+    return !mapper_scanline_irq_enabled(ppu->agnes);
+}
+
+// Does everything ppu_tick() does over dots 1 to 340 of a visible line, but
+// fetches the background a tile at a time and draws the sprites into a line
+// buffer up front
+static void render_scanline(ppu_t *ppu) {
+    const int y = ppu->scanline;
+    uint8_t *line = &ppu->screen_buffer[y * AGNES_SCREEN_WIDTH];
+
+    uint8_t sprite_line[AGNES_SCREEN_WIDTH];
+    build_sprite_line(ppu, sprite_line);
+
+    const bool show_background = ppu->masks.show_background;
+    const bool show_leftmost_bg = ppu->masks.show_leftmost_bg;
+    const bool hide_leftmost = !show_leftmost_bg && !ppu->masks.show_leftmost_sprites;
+    const int bg_bit = 15 - ppu->regs.x;
+    const int at_bit = 14 - (ppu->regs.x << 1);
+
+    // Dots 1-256
+    for (int tile = 0; tile < 32; tile++) {
+        for (int i = 0; i < 8; i++) {
+            const int x = (tile << 3) + i;
+
+            if (x < 8 && hide_leftmost) {
+                set_pixel_color_ix(ppu, x, y, 63); // 63 is black in my default colour palette
+            } else {
+                uint8_t bg_color = 0;
+                if (show_background && (x >= 8 || show_leftmost_bg)) {
+                    uint8_t lo_bit = AGNES_GET_BIT(ppu->bg_lo_shift, bg_bit);
+                    uint8_t hi_bit = AGNES_GET_BIT(ppu->bg_hi_shift, bg_bit);
+                    if (lo_bit || hi_bit) {
+                        uint8_t palette = (ppu->at_shift >> at_bit) & 0x3;
+                        bg_color = (palette << 2) | (hi_bit << 1) | lo_bit;
+                    }
+                }
+
+                uint8_t sp = sprite_line[x];
+                uint8_t color = 0;
+                if (bg_color && sp) {
+                    if ((sp & SPRITE_LINE_SPRITE_ZERO) && x != 255) {
+                        ppu->status.sprite_zero_hit = true;
+                    }
+                    color = (sp & SPRITE_LINE_BEHIND_BG) ? bg_color : (sp & 0x1f);
+                } else if (bg_color) {
+                    color = bg_color;
+                } else if (sp) {
+                    color = sp & 0x1f;
+                }
+
+                line[x] = ppu->palette[g_palette_addr_map[color]];
+            }
+
+            ppu->bg_lo_shift <<= 1;
+            ppu->bg_hi_shift <<= 1;
+            ppu->at_shift = (ppu->at_shift << 2) | (ppu->at_latch & 0x3);
+        }
+
+        fetch_tile(ppu);
+
+        if (tile == 31) {
+            inc_vert_v(ppu);
+        } else {
+            inc_hori_v(ppu);
+        }
+    }
+
+    if (ppu->agnes->scanline_callback != NULL) {
+        ppu->agnes->scanline_callback(y, line, ppu->agnes->scanline_callback_work);
+    }
+
+    // Dot 257
+    ppu->regs.v = (ppu->regs.v & 0xfbe0) | (ppu->regs.t & ~(0xfbe0));
+    eval_sprites(ppu);
+
+    // Dot 270 or 324, depending on the background pattern table. See
+    // scanline_visible_pre()
+    if (ppu->masks.show_background && ppu->masks.show_sprites) {
+        mapper_pa12_rising_edge(ppu->agnes);
+    }
+
+    // Dots 321-336, the first two tiles of the next line
+    for (int tile = 0; tile < 2; tile++) {
+        ppu->bg_lo_shift <<= 8;
+        ppu->bg_hi_shift <<= 8;
+        for (int i = 0; i < 8; i++) {
+            ppu->at_shift = (ppu->at_shift << 2) | (ppu->at_latch & 0x3);
+        }
+
+        fetch_tile(ppu);
+        inc_hori_v(ppu);
+    }
+
+    ppu->dot = SCANLINE_BATCH_DOTS;
+}
+
+// The fetches of dots 1, 3, 5 and 7 of a tile, and the reload of dot 0
+static void fetch_tile(ppu_t *ppu) {
+    uint16_t v = ppu->regs.v;
+
+    ppu->nt = ppu_read8(ppu, 0x2000 | (v & 0x0fff));
+
+    ppu->at = ppu_read8(ppu, 0x23C0 | (v & 0x0C00) | ((v >> 4) & 0x38) | ((v >> 2) & 0x07));
+    if (v & 0x40) {
+        ppu->at = ppu->at >> 4;
+    }
+    if (v & 0x02) {
+        ppu->at = ppu->at >> 2;
+    }
+
+    uint8_t fine_y = (v >> 12) & 0x7;
+    uint16_t addr = ppu->ctrl.bg_table_addr + (ppu->nt << 4) + fine_y;
+    ppu->bg_lo = ppu_read8(ppu, addr);
+    ppu->bg_hi = ppu_read8(ppu, addr + 8);
+
+    ppu->bg_lo_shift = (ppu->bg_lo_shift & 0xff00) | ppu->bg_lo;
+    ppu->bg_hi_shift = (ppu->bg_hi_shift & 0xff00) | ppu->bg_hi;
+
+    ppu->at_latch = ppu->at & 0x3;
+}
+
+// Same priorities as get_sprite_color_addr(): the first sprite with an opaque
+// pixel wins, so draw in reverse
+static void build_sprite_line(ppu_t *ppu, uint8_t *sprite_line) {
+    memset(sprite_line, 0, AGNES_SCREEN_WIDTH);
+
+    if (!ppu->masks.show_sprites) {
+        return;
+    }
+
+    const int y = ppu->scanline;
+    const int sprite_height = ppu->ctrl.use_8x16_sprites ? 16 : 8;
+    const int x_min = ppu->masks.show_leftmost_sprites ? 0 : 8;
+
+    for (int i = ppu->sprite_ixs_count - 1; i >= 0; i--) {
+        const sprite_t *sprite = &ppu->sprites[i];
+
+        int s_y = y - sprite->y_pos - 1;
+        s_y = AGNES_GET_BIT(sprite->attrs, 7) ? (sprite_height - 1 - s_y) : s_y; // flip vert
+
+        uint16_t table = ppu->ctrl.sprite_table_addr;
+        uint8_t tile_num = sprite->tile_num;
+        if (ppu->ctrl.use_8x16_sprites) {
+            table = tile_num & 0x1 ? 0x1000 : 0x0000;
+            tile_num &= 0xfe;
+            if (s_y >= 8) {
+                tile_num += 1;
+                s_y -= 8;
+            }
+        }
+
+        uint16_t offset = table + (tile_num << 4) + s_y;
+
+        uint8_t lo_byte = ppu_read8(ppu, offset);
+        uint8_t hi_byte = ppu_read8(ppu, offset + 8);
+
+        if (!lo_byte && !hi_byte) {
+            continue;
+        }
+
+        uint8_t attrs = 0x10 | ((sprite->attrs & 0x3) << 2);
+        if (AGNES_GET_BIT(sprite->attrs, 5)) {
+            attrs |= SPRITE_LINE_BEHIND_BG;
+        }
+        if (ppu->sprite_ixs[i] == 0) {
+            attrs |= SPRITE_LINE_SPRITE_ZERO;
+        }
+
+        const bool flip_hor = AGNES_GET_BIT(sprite->attrs, 6);
+
+        for (int s_x = 0; s_x < 8; s_x++) {
+            int x = sprite->x_pos + s_x;
+            if (x >= AGNES_SCREEN_WIDTH) {
+                break;
+            }
+            if (x < x_min) {
+                continue;
+            }
+
+            int bit = flip_hor ? s_x : 7 - s_x;
+            uint8_t palette_ix = (AGNES_GET_BIT(hi_byte, bit) << 1) | AGNES_GET_BIT(lo_byte, bit);
+
+            if (palette_ix) {
+                sprite_line[x] = attrs | palette_ix;
+            }
+        }
+    }
+}
+
+#undef SPRITE_LINE_SPRITE_ZERO
+#undef SPRITE_LINE_BEHIND_BG
+#undef SCANLINE_BATCH_DOTS
+#endif
+
 uint8_t ppu_read_register(ppu_t *ppu, uint16_t addr) {
     switch (addr) {
         case 0x2002: { // PPUSTATUS
@@ -1418,8 +1864,7 @@ void ppu_write_register(ppu_t *ppu, uint16_t addr, uint8_t val) {
         case 0x4014: { // OAMDMA
             uint16_t dma_addr = ((uint16_t)val) << 8;
             for (int i = 0; i < 256; i++) {
-                ppu->oam_data[ppu->oam_address] = cpu_read8(&ppu->agnes->cpu, dma_addr);
-                ppu->oam_address++;
+                ppu_write_oam_dma(ppu, cpu_read8(&ppu->agnes->cpu, dma_addr));
                 dma_addr++;
             }
             cpu_set_dma_stall(&ppu->agnes->cpu);
@@ -1428,6 +1873,12 @@ void ppu_write_register(ppu_t *ppu, uint16_t addr, uint8_t val) {
     }
 }
 
+// One byte of an OAM DMA. Unlike a write to OAMDATA, doesn't latch the value
+void ppu_write_oam_dma(ppu_t *ppu, uint8_t val) {
+    ppu->oam_data[ppu->oam_address] = val;
+    ppu->oam_address++;
+}
+
 static void set_pixel_color_ix(ppu_t *ppu, int x, int y, uint8_t color_ix) {
     int ix = (y * AGNES_SCREEN_WIDTH) + x;
     ppu->screen_buffer[ix] = color_ix;
@@ -2247,11 +2698,65 @@ void mapper_write(agnes_t *agnes, uint16_t addr, uint8_t val) {
     }
 }
 
+// Points the CPU's PRG-RAM and PRG-ROM pages at the mapper's current banks.
+// Pages left NULL (PRG-RAM on mappers without it) go through mapper_read() and
+// mapper_write(), as do the mapper registers. Called again on every bank switch
+void mapper_map_prg(agnes_t *agnes) {
+    uint8_t *prg_ram = NULL;
+    const unsigned *prg_bank_offsets = NULL;
+    int prg_bank_shift = 14; // 16KB banks
+    switch (agnes->gamepack.mapper) {
+        case 0: {
+            prg_bank_offsets = agnes->mapper.m0.prg_bank_offsets;
+            break;
+        }
+        case 1: {
+            prg_ram = agnes->mapper.m1.prg_ram;
+            prg_bank_offsets = agnes->mapper.m1.prg_bank_offsets;
+            break;
+        }
+        case 2: {
+            prg_bank_offsets = agnes->mapper.m2.prg_bank_offsets;
+            break;
+        }
+        case 4: {
+            prg_ram = agnes->mapper.m4.prg_ram;
+            prg_bank_offsets = agnes->mapper.m4.prg_bank_offsets;
+            prg_bank_shift = 13; // 8KB banks
+            break;
+        }
+        default: return;
+    }
+
+    cpu_page_t *pages = agnes->cpu.pages;
+    for (unsigned i = 0x60; i < 0x80; i++) {
+        pages[i].write = (prg_ram != NULL) ? &prg_ram[(i - 0x60) << 8] : NULL;
+        pages[i].read = pages[i].write;
+    }
+
+    const uint8_t *prg_rom = &agnes->gamepack.data[agnes->gamepack.prg_rom_offset];
+    unsigned addr_mask = (1u << prg_bank_shift) - 1;
+    for (unsigned i = 0x80; i < 0x100; i++) {
+        unsigned addr = i << 8;
+        unsigned bank = (addr - 0x8000) >> prg_bank_shift;
+        pages[i].read = &prg_rom[prg_bank_offsets[bank] + (addr & addr_mask)];
+    }
+}
+
 void mapper_pa12_rising_edge(agnes_t *agnes) {
     switch (agnes->gamepack.mapper) {
         case 4: mapper4_pa12_rising_edge(&agnes->mapper.m4); break;
     }
 }
+
+#ifdef AGNES_SCANLINE_RENDERER
+bool mapper_scanline_irq_enabled(agnes_t *agnes) {
+    switch (agnes->gamepack.mapper) {
+        case 4: return agnes->mapper.m4.irq_enabled;
+        default: return false;
+    }
+}
+#endif
 //FILE_END
 //FILE_START:mapper0.c
 #ifndef AGNES_SINGLE_HEADER
@@ -2297,6 +2802,7 @@ void mapper0_write(mapper0_t *mapper, uint16_t addr, uint8_t val) {
 #include "mapper1.h"
 
 #include "agnes_types.h"
+#include "mapper.h"
 #endif
 
 static void mapper1_write_control(mapper1_t *mapper, uint8_t val);
@@ -2421,12 +2927,15 @@ static void mapper1_set_offsets(mapper1_t *mapper) {
             break;
         }
     }
+
+    mapper_map_prg(mapper->agnes);
 }
 //FILE_END
 //FILE_START:mapper2.c
 #ifndef AGNES_SINGLE_HEADER
 #include "mapper2.h"
 #include "agnes_types.h"
+#include "mapper.h"
 #endif
 
 void mapper2_init(mapper2_t *mapper, agnes_t *agnes) {
@@ -2455,6 +2964,7 @@ void mapper2_write(mapper2_t *mapper, uint16_t addr, uint8_t val) {
     } else if (addr >= 0x8000) {
         int bank = val % (mapper->agnes->gamepack.prg_rom_banks_count);
         mapper->prg_bank_offsets[0] = bank * (16 * 1024);
+        mapper_map_prg(mapper->agnes);
     }
 }
 //FILE_END
@@ -2464,6 +2974,7 @@ void mapper2_write(mapper2_t *mapper, uint16_t addr, uint8_t val) {
 
 #include "agnes_types.h"
 #include "cpu.h"
+#include "mapper.h"
 #endif
 
 static void mapper4_write_register(mapper4_t *mapper, uint16_t addr, uint8_t val);
@@ -2499,7 +3010,12 @@ void mapper4_pa12_rising_edge(mapper4_t *mapper) {
     } else {
         mapper->counter--;
         if (mapper->counter == 0 && mapper->irq_enabled) {
-            cpu_trigger_irq(&mapper->agnes->cpu);
+            agnes_t *agnes = mapper->agnes;
+            if (agnes->ppu_bridge != NULL) {
+                agnes->ppu_bridge->trigger_irq(agnes, agnes->ppu_bridge_work);
+            } else {
+                cpu_trigger_irq(&agnes->cpu);
+            }
         }
     }
 }
@@ -2615,6 +3131,8 @@ static void mapper4_set_offsets(mapper4_t *mapper) {
             break;
         }
     }
+
+    mapper_map_prg(mapper->agnes);
 }
 //FILE_END
 
@@ -11,6 +11,16 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+#define PPU_SLAVE       1 /* 0: Run the PPU inline with the CPU   1: Run the PPU on the slave SH-2 */
+
+#define PPU_SCANLINE_RENDERER   1 /* 0: Run the PPU a dot at a time   1: Render whole visible lines when the CPU doesn't access the PPU mid-line (PPU_SLAVE 0 only) */
+
+/* The slave never gets to render whole lines: the CPU may only lead it by
+ * PPU_SLAVE_LEAD_MAX dots, far less than a line */
+#if (PPU_SCANLINE_RENDERER == 1) && (PPU_SLAVE == 0)
+#define AGNES_SCANLINE_RENDERER
+#endif /* PPU_SCANLINE_RENDERER && !PPU_SLAVE */
+
 #define AGNES_IMPLEMENTATION
 #define AGNES_SINGLE_HEADER
 
@@ -18,8 +28,136 @@
 
 #include "game.inc"
 
+#define VIDEO_INDEXED   1 /* 0: Convert each pixel to RGB1555   1: 256-color bitmap, DMA the palette indices */
+#define VIDEO_STREAMED  1 /* 0: Transfer the frame once it's emulated   1: Transfer each line as soon as it's emulated (VIDEO_INDEXED only) */
+
+/* How far ahead of the PPU, in PPU dots, the CPU may run. MMC3 IRQs reach the
+ * CPU up to twice as late */
+#define PPU_SLAVE_LEAD_MAX      114
+
+/* Must be a power of 2, and hold at least an OAM DMA */
+#define PPU_EVENT_COUNT         512
+
+#define PPU_EVENT_TYPE_WRITE    0
+#define PPU_EVENT_TYPE_READ     1
+#define PPU_EVENT_TYPE_OAM_DMA  2
+#define PPU_EVENT_TYPE_MAPPER   3
+
+#define PPU_DOTS_PER_SCANLINE   341
+#define PPU_DOTS_PER_FRAME      (262 * PPU_DOTS_PER_SCANLINE)
+/* From the start of a frame to dot 1 of scanline 241 */
+#define PPU_VBLANK_DOT          ((241 * PPU_DOTS_PER_SCANLINE) + 1)
+
+#define NBG0_BITMAP     VDP2_VRAM_ADDR(0, 0x00000)
+#define NBG0_PAL        VDP2_CRAM_ADDR(0x0000)
+
+/* The bitmap is 512 pixels wide. Center the 256 pixel wide NES screen in the
+ * 320 pixel wide display */
+#define SCREEN_X_OFFSET 32
+
 static void _hardware_init(void);
 
+#if VIDEO_INDEXED == 1
+static void _palette_load(void);
+
+#if VIDEO_STREAMED == 1
+static void _screen_line_upload(int, const uint8_t *, void *);
+#else
+static void _screen_xfer_init(void);
+static void _screen_upload(void);
+
+/* One transfer per NES line, as the bitmap's rows are longer than the NES
+ * screen's. The SCU requires the table to be aligned to its size rounded up
+ * to a power of 2 */
+static scu_dma_xfer_t _screen_xfer_table[AGNES_SCREEN_HEIGHT] __aligned(4096);
+static scu_dma_handle_t _screen_dma_handle;
+#endif /* VIDEO_STREAMED */
+#else
+static void _screen_blit(void);
+#endif /* VIDEO_INDEXED */
+
+#if PPU_SLAVE == 1
+/* A PPU register access made by the CPU, applied once the PPU reaches time.
+ * Times are in PPU dots */
+struct ppu_event {
+    uint32_t time;
+    uint16_t addr;
+    uint8_t value;
+    uint8_t type;
+};
+
+/* Shared by both CPUs. The master only writes events[], event_head and
+ * cpu_time, and the slave only writes the rest, so no locks are needed */
+static struct {
+    volatile ppu_event events[PPU_EVENT_COUNT];
+    volatile uint32_t event_head;
+    volatile uint32_t event_tail;
+
+    /* Time the CPU has been emulated up to. The PPU never passes it */
+    volatile uint32_t cpu_time;
+    /* Time the PPU has been emulated up to */
+    volatile uint32_t ppu_time;
+    /* Time at which the PPU enters the current frame's VBLANK */
+    volatile uint32_t vblank_time;
+
+    volatile uint32_t nmi_count;
+    volatile uint32_t irq_count;
+
+    /* Result of the last PPU_EVENT_TYPE_READ event */
+    volatile uint32_t read_count;
+    volatile uint8_t read_value;
+
+    /* Visible lines of the current frame rendered so far */
+    volatile uint32_t line_count;
+} _ppu_sync __section(".uncached");
+
+/* Only touched by the master */
+static struct {
+    uint32_t time;
+    uint32_t event_head;
+
+    /* Last values read from _ppu_sync */
+    uint32_t ppu_time;
+    uint32_t nmi_count;
+    uint32_t irq_count;
+    uint32_t read_count;
+    uint32_t line_count;
+
+    /* VBLANK last handled, and when to look for the next one */
+    uint32_t vblank_time;
+    uint32_t vblank_check_time;
+} _ppu_master;
+
+static void _ppu_slave_init(void);
+static void _ppu_event_push(uint8_t, uint16_t, uint8_t);
+static void _ppu_catch_up(void);
+static void _ppu_master_poll(bool *);
+
+static void _ppu_bridge_advance(agnes_t *, int, bool *, void *);
+static uint8_t _ppu_bridge_read_register(agnes_t *, uint16_t, void *);
+static void _ppu_bridge_write_register(agnes_t *, uint16_t, uint8_t, void *);
+static void _ppu_bridge_write_mapper(agnes_t *, uint16_t, uint8_t, void *);
+static void _ppu_bridge_trigger_nmi(agnes_t *, void *);
+static void _ppu_bridge_trigger_irq(agnes_t *, void *);
+
+#if (VIDEO_INDEXED == 1) && (VIDEO_STREAMED == 1)
+static void _ppu_slave_line_done(int, const uint8_t *, void *);
+#endif /* VIDEO_INDEXED && VIDEO_STREAMED */
+
+static void _slave_entry(void);
+static uint32_t _ppu_slave_run(ppu_t *, uint32_t, uint32_t);
+static void _ppu_slave_event_apply(ppu_t *, volatile ppu_event *);
+
+static const agnes_ppu_bridge_t _ppu_bridge = {
+    .advance = _ppu_bridge_advance,
+    .read_register = _ppu_bridge_read_register,
+    .write_register = _ppu_bridge_write_register,
+    .write_mapper = _ppu_bridge_write_mapper,
+    .trigger_nmi = _ppu_bridge_trigger_nmi,
+    .trigger_irq = _ppu_bridge_trigger_irq
+};
+#endif /* PPU_SLAVE */
+
 static void _vblank_out_handler(void);
 
 static void _input_process(agnes_input_t *);
@@ -32,6 +170,23 @@ main(void) {
 
     agnes_load_ines_data(&_agnes, const_cast<uint8_t*>(game_data), game_size);
 
+#if VIDEO_INDEXED == 1
+#if VIDEO_STREAMED == 1
+#if PPU_SLAVE == 1
+    /* The master uploads the lines as the slave reports them */
+    agnes_set_scanline_callback(&_agnes, _ppu_slave_line_done, NULL);
+#else
+    agnes_set_scanline_callback(&_agnes, _screen_line_upload, NULL);
+#endif /* PPU_SLAVE */
+#else
+    _screen_xfer_init();
+#endif /* VIDEO_STREAMED */
+#endif /* VIDEO_INDEXED */
+
+#if PPU_SLAVE == 1
+    _ppu_slave_init();
+#endif /* PPU_SLAVE */
+
     while (true) {
         agnes_input_t input;
         _input_process(&input);
@@ -39,29 +194,364 @@ main(void) {
         agnes_set_input(&_agnes, &input, NULL);
         agnes_next_frame(&_agnes);
 
-        for (uint32_t y = 0; y < AGNES_SCREEN_HEIGHT; y++) {
-            for (uint32_t x = 0; x < AGNES_SCREEN_WIDTH; x++) {
-                const agnes_color_t nes_rgb = agnes_get_screen_pixel(&_agnes, x, y);
+#if VIDEO_INDEXED == 1
+#if VIDEO_STREAMED == 0
+        _screen_upload();
+#endif /* VIDEO_STREAMED */
+#else
+        _screen_blit();
+#endif /* VIDEO_INDEXED */
+
+        vdp_sync();
+    }
+
+    return 0;
+}
 
-                color_rgb1555_t color;
-                color.r = nes_rgb.r;
-                color.g = nes_rgb.g;
-                color.b = nes_rgb.b;
+#if VIDEO_INDEXED == 1
+static void _palette_load(void) {
+    volatile uint16_t * const cram = (volatile uint16_t *)NBG0_PAL;
 
-                const uint32_t vram_offset = 2 * ((y * 512) + x + 32);
-                volatile uint16_t * const vram =
-                    (volatile uint16_t *)(VDP2_VRAM_ADDR(0, 0x00000) + vram_offset);
+    /* Only the low 6 bits of a palette index are significant, so repeat the
+     * 64 colors over the whole 256-color palette rather than masking each
+     * pixel */
+    for (uint32_t i = 0; i < 256; i++) {
+        const agnes_color_t nes_rgb = agnes_get_palette_color(i);
 
-                *vram = color.raw;
-            }
+        cram[i] = COLOR_RGB1555(1, nes_rgb.r >> 3, nes_rgb.g >> 3, nes_rgb.b >> 3);
+    }
+}
+
+#if VIDEO_STREAMED == 1
+/* Called by the PPU at the end of each visible line. The line is transferred
+ * while the next one is emulated. As the transfers aren't synchronized to the
+ * display, a frame can tear */
+static void _screen_line_upload(int scanline, const uint8_t *line, void *) {
+    scu_dma_level_cfg_t scu_dma_level_cfg;
+
+    scu_dma_level_cfg.mode = SCU_DMA_MODE_DIRECT;
+    scu_dma_level_cfg.stride = SCU_DMA_STRIDE_2_BYTES;
+    scu_dma_level_cfg.update = SCU_DMA_UPDATE_NONE;
+    scu_dma_level_cfg.xfer.direct.len = AGNES_SCREEN_WIDTH;
+    scu_dma_level_cfg.xfer.direct.dst = NBG0_BITMAP + (scanline * 512) + SCREEN_X_OFFSET;
+    scu_dma_level_cfg.xfer.direct.src = CPU_CACHE_THROUGH | (uint32_t)line;
+
+    scu_dma_handle_t handle;
+
+    scu_dma_config_buffer(&handle, &scu_dma_level_cfg);
+
+    const int8_t ret __unused =
+        dma_queue_enqueue(&handle, DMA_QUEUE_TAG_IMMEDIATE, NULL, NULL);
+    assert(ret == 0);
+
+    dma_queue_flush(DMA_QUEUE_TAG_IMMEDIATE);
+}
+#else
+static void _screen_xfer_init(void) {
+    const uint8_t * const screen_buffer = agnes_get_screen_buffer(&_agnes);
+
+    for (uint32_t y = 0; y < AGNES_SCREEN_HEIGHT; y++) {
+        _screen_xfer_table[y].len = AGNES_SCREEN_WIDTH;
+        _screen_xfer_table[y].dst = NBG0_BITMAP + (y * 512) + SCREEN_X_OFFSET;
+        _screen_xfer_table[y].src = CPU_CACHE_THROUGH |
+            (uint32_t)&screen_buffer[y * AGNES_SCREEN_WIDTH];
+    }
+
+    _screen_xfer_table[AGNES_SCREEN_HEIGHT - 1].src |= SCU_DMA_INDIRECT_TABLE_END;
+
+    scu_dma_level_cfg_t scu_dma_level_cfg;
+
+    scu_dma_level_cfg.mode = SCU_DMA_MODE_INDIRECT;
+    scu_dma_level_cfg.stride = SCU_DMA_STRIDE_2_BYTES;
+    scu_dma_level_cfg.update = SCU_DMA_UPDATE_NONE;
+    scu_dma_level_cfg.xfer.indirect = &_screen_xfer_table[0];
+
+    scu_dma_config_buffer(&_screen_dma_handle, &scu_dma_level_cfg);
+}
+
+/* Transfer the whole frame's palette indices (60 KiB) to the bitmap during
+ * the next VBLANK-IN */
+static void _screen_upload(void) {
+    const int8_t ret __unused =
+        dma_queue_enqueue(&_screen_dma_handle, DMA_QUEUE_TAG_VBLANK_IN, NULL, NULL);
+    assert(ret == 0);
+}
+#endif /* VIDEO_STREAMED */
+#else
+static void _screen_blit(void) {
+#if PPU_SLAVE == 1
+    /* The slave wrote the screen buffer */
+    cpu_cache_purge();
+#endif /* PPU_SLAVE */
+
+    for (uint32_t y = 0; y < AGNES_SCREEN_HEIGHT; y++) {
+        for (uint32_t x = 0; x < AGNES_SCREEN_WIDTH; x++) {
+            const agnes_color_t nes_rgb = agnes_get_screen_pixel(&_agnes, x, y);
+
+            color_rgb1555_t color;
+            color.r = nes_rgb.r;
+            color.g = nes_rgb.g;
+            color.b = nes_rgb.b;
+
+            const uint32_t vram_offset = 2 * ((y * 512) + x + SCREEN_X_OFFSET);
+            volatile uint16_t * const vram =
+                (volatile uint16_t *)(NBG0_BITMAP + vram_offset);
+
+            *vram = color.raw;
         }
+    }
+}
+#endif /* VIDEO_INDEXED */
 
-        vdp_sync();
+#if PPU_SLAVE == 1
+static void _ppu_slave_init(void) {
+    (void)memset((void *)&_ppu_sync, 0x00, sizeof(_ppu_sync));
+    (void)memset(&_ppu_master, 0x00, sizeof(_ppu_master));
+
+    /* The PPU starts at the beginning of a frame */
+    _ppu_sync.vblank_time = PPU_VBLANK_DOT;
+    _ppu_master.vblank_check_time = PPU_VBLANK_DOT;
+
+    agnes_set_ppu_bridge(&_agnes, &_ppu_bridge, NULL);
+
+    cpu_dual_init(CPU_DUAL_ENTRY_POLLING);
+    cpu_dual_slave_set(_slave_entry);
+    cpu_dual_slave_notify();
+}
+
+/* Queue an access to be made once the PPU reaches the CPU's current time */
+static void _ppu_event_push(uint8_t type, uint16_t addr, uint8_t value) {
+    const uint32_t head = _ppu_master.event_head;
+
+    /* Wait for the slave to make room */
+    while ((head - _ppu_sync.event_tail) >= PPU_EVENT_COUNT) {
     }
 
-    return 0;
+    volatile ppu_event * const event = &_ppu_sync.events[head & (PPU_EVENT_COUNT - 1)];
+
+    event->time = _ppu_master.time;
+    event->addr = addr;
+    event->value = value;
+    event->type = type;
+
+    _ppu_master.event_head = head + 1;
+    _ppu_sync.event_head = head + 1;
+}
+
+/* Wait for the PPU to reach the CPU's current time, with every queued event
+ * applied. The slave then idles until the CPU moves on */
+static void _ppu_catch_up(void) {
+    while ((_ppu_sync.ppu_time != _ppu_master.time) ||
+           (_ppu_sync.event_tail != _ppu_master.event_head)) {
+    }
+
+    _ppu_master.ppu_time = _ppu_master.time;
 }
 
+static void _ppu_master_poll(bool *out_new_frame) {
+    const uint32_t time = _ppu_master.time;
+
+    do {
+        _ppu_master.ppu_time = _ppu_sync.ppu_time;
+    } while ((int32_t)(time - _ppu_master.ppu_time) > PPU_SLAVE_LEAD_MAX);
+
+    const uint32_t vblank_time = _ppu_sync.vblank_time;
+
+    if (vblank_time != _ppu_master.vblank_time) {
+        _ppu_master.vblank_check_time = vblank_time;
+
+        /* Stop at the same instruction the PPU would have, had it run
+         * inline, so that the NMI isn't late */
+        if ((int32_t)(time - vblank_time) >= 0) {
+            _ppu_catch_up();
+
+            _ppu_master.vblank_time = vblank_time;
+            /* The earliest the next frame's VBLANK can be */
+            _ppu_master.vblank_check_time = vblank_time + PPU_DOTS_PER_FRAME - 1;
+
+            *out_new_frame = true;
+        }
+    }
+
+    const uint32_t nmi_count = _ppu_sync.nmi_count;
+
+    if (nmi_count != _ppu_master.nmi_count) {
+        _ppu_master.nmi_count = nmi_count;
+
+        cpu_trigger_nmi(&_agnes.cpu);
+    }
+
+    const uint32_t irq_count = _ppu_sync.irq_count;
+
+    if (irq_count != _ppu_master.irq_count) {
+        _ppu_master.irq_count = irq_count;
+
+        cpu_trigger_irq(&_agnes.cpu);
+    }
+
+#if (VIDEO_INDEXED == 1) && (VIDEO_STREAMED == 1)
+    const uint32_t line_count = _ppu_sync.line_count;
+
+    /* The PPU started a new frame */
+    if (line_count < _ppu_master.line_count) {
+        _ppu_master.line_count = 0;
+    }
+
+    const uint8_t * const screen_buffer = agnes_get_screen_buffer(&_agnes);
+
+    for (; _ppu_master.line_count < line_count; _ppu_master.line_count++) {
+        const uint32_t y = _ppu_master.line_count;
+
+        _screen_line_upload(y, &screen_buffer[y * AGNES_SCREEN_WIDTH], NULL);
+    }
+#endif /* VIDEO_INDEXED && VIDEO_STREAMED */
+}
+
+static void _ppu_bridge_advance(agnes_t *, int ppu_cycles, bool *out_new_frame, void *) {
+    const uint32_t time = _ppu_master.time + ppu_cycles;
+
+    _ppu_master.time = time;
+    _ppu_sync.cpu_time = time;
+
+    if (((int32_t)(time - _ppu_master.ppu_time) > PPU_SLAVE_LEAD_MAX) ||
+        ((int32_t)(time - _ppu_master.vblank_check_time) >= 0)) {
+        _ppu_master_poll(out_new_frame);
+    }
+}
+
+/* Reads have side effects, and must see every earlier write, so they're made
+ * by the slave once the PPU catches up */
+static uint8_t _ppu_bridge_read_register(agnes_t *, uint16_t addr, void *) {
+    _ppu_event_push(PPU_EVENT_TYPE_READ, addr, 0x00);
+
+    const uint32_t read_count = _ppu_master.read_count + 1;
+
+    while (_ppu_sync.read_count != read_count) {
+    }
+
+    _ppu_master.read_count = read_count;
+    _ppu_master.ppu_time = _ppu_master.time;
+
+    return _ppu_sync.read_value;
+}
+
+static void _ppu_bridge_write_register(agnes_t *agnes, uint16_t addr, uint8_t val, void *) {
+    if (addr != 0x4014) {
+        _ppu_event_push(PPU_EVENT_TYPE_WRITE, addr, val);
+
+        return;
+    }
+
+    /* OAM DMA reads CPU memory, so make the reads here and queue the bytes */
+    uint16_t dma_addr = ((uint16_t)val) << 8;
+
+    for (uint32_t i = 0; i < 256; i++) {
+        _ppu_event_push(PPU_EVENT_TYPE_OAM_DMA, 0x2004, cpu_read8(&agnes->cpu, dma_addr));
+
+        dma_addr++;
+    }
+
+    cpu_set_dma_stall(&agnes->cpu);
+}
+
+static void _ppu_bridge_write_mapper(agnes_t *agnes, uint16_t addr, uint8_t val, void *) {
+    /* PRG-RAM isn't seen by the PPU */
+    if (addr < 0x8000) {
+        mapper_write(agnes, addr, val);
+
+        return;
+    }
+
+    /* Bank switches and mirroring changes must take effect exactly when the
+     * PPU gets here. The slave then discards what it cached of the mapper */
+    _ppu_catch_up();
+
+    mapper_write(agnes, addr, val);
+
+    _ppu_event_push(PPU_EVENT_TYPE_MAPPER, addr, val);
+}
+
+static void _ppu_bridge_trigger_nmi(agnes_t *, void *) {
+    _ppu_sync.nmi_count = _ppu_sync.nmi_count + 1;
+}
+
+static void _ppu_bridge_trigger_irq(agnes_t *, void *) {
+    _ppu_sync.irq_count = _ppu_sync.irq_count + 1;
+}
+
+#if (VIDEO_INDEXED == 1) && (VIDEO_STREAMED == 1)
+static void _ppu_slave_line_done(int scanline, const uint8_t *, void *) {
+    _ppu_sync.line_count = scanline + 1;
+}
+#endif /* VIDEO_INDEXED && VIDEO_STREAMED */
+
+static void _slave_entry(void) {
+    /* The master set up the PPU and the mapper */
+    cpu_cache_purge();
+
+    ppu_t * const ppu = &_agnes.ppu;
+
+    uint32_t time = 0;
+    uint32_t tail = 0;
+
+    while (true) {
+        /* Read in this order. The master publishes cpu_time before it
+         * queues the events stamped with it, so every event up to head is
+         * stamped no later than the cpu_time read after it. Reading cpu_time
+         * first could leave the PPU ahead of it after the events are
+         * applied */
+        const uint32_t head = _ppu_sync.event_head;
+        const uint32_t cpu_time = _ppu_sync.cpu_time;
+
+        for (; tail != head; tail++) {
+            volatile ppu_event * const event = &_ppu_sync.events[tail & (PPU_EVENT_COUNT - 1)];
+
+            time = _ppu_slave_run(ppu, time, event->time);
+
+            _ppu_slave_event_apply(ppu, event);
+
+            _ppu_sync.event_tail = tail + 1;
+        }
+
+        time = _ppu_slave_run(ppu, time, cpu_time);
+
+        _ppu_sync.ppu_time = time;
+    }
+}
+
+static uint32_t _ppu_slave_run(ppu_t *ppu, uint32_t time, uint32_t end_time) {
+    for (; time != end_time; time++) {
+        bool new_frame;
+
+        ppu_tick(ppu, &new_frame);
+
+        if ((ppu->dot == 0) && (ppu->scanline == 0)) {
+            _ppu_sync.vblank_time = time + 1 + PPU_VBLANK_DOT;
+        }
+    }
+
+    return time;
+}
+
+static void _ppu_slave_event_apply(ppu_t *ppu, volatile ppu_event *event) {
+    switch (event->type) {
+    case PPU_EVENT_TYPE_WRITE:
+        ppu_write_register(ppu, event->addr, event->value);
+        break;
+    case PPU_EVENT_TYPE_READ:
+        _ppu_sync.read_value = ppu_read_register(ppu, event->addr);
+        _ppu_sync.read_count = _ppu_sync.read_count + 1;
+        break;
+    case PPU_EVENT_TYPE_OAM_DMA:
+        ppu_write_oam_dma(ppu, event->value);
+        break;
+    case PPU_EVENT_TYPE_MAPPER:
+        cpu_cache_purge();
+        break;
+    }
+}
+#endif /* PPU_SLAVE */
+
 static void _hardware_init(void) {
     vdp2_tvmd_display_clear();
 
@@ -69,11 +559,16 @@ static void _hardware_init(void) {
     memset(&format, 0x00, sizeof(format));
 
     format.scroll_screen = VDP2_SCRN_NBG0;
+#if VIDEO_INDEXED == 1
+    format.cc_count = VDP2_SCRN_CCC_PALETTE_256;
+    format.color_palette = NBG0_PAL;
+#else
     format.cc_count = VDP2_SCRN_CCC_RGB_32768;
+    format.color_palette = 0x00000000;
+#endif /* VIDEO_INDEXED */
     format.bitmap_size.width = 512;
     format.bitmap_size.height = 256;
-    format.color_palette = 0x00000000;
-    format.bitmap_pattern = VDP2_VRAM_ADDR(0, 0x00000);
+    format.bitmap_pattern = NBG0_BITMAP;
     format.rp_mode = 0;
     format.sf_type = VDP2_SCRN_SF_TYPE_NONE;
     format.sf_code = VDP2_SCRN_SF_CODE_A;
@@ -81,7 +576,12 @@ static void _hardware_init(void) {
 
     vdp2_scrn_bitmap_format_set(&format);
     vdp2_scrn_priority_set(VDP2_SCRN_NBG0, 7);
+#if VIDEO_INDEXED == 1
+    /* Palette index 0 is a color (gray) on the NES */
+    vdp2_scrn_display_set(VDP2_SCRN_NBG0, /* no_trans = */ true);
+#else
     vdp2_scrn_display_set(VDP2_SCRN_NBG0, /* no_trans = */ false);
+#endif /* VIDEO_INDEXED */
 
     vdp2_vram_cycp_t vram_cycp;
 
@@ -123,6 +623,10 @@ static void _hardware_init(void) {
 
     vdp2_vram_cycp_set(&vram_cycp);
 
+#if VIDEO_INDEXED == 1
+    _palette_load();
+#endif /* VIDEO_INDEXED */
+
     vdp2_scrn_back_screen_color_set(VDP2_VRAM_ADDR(3, 0x01FFFE), COLOR_RGB1555(1, 0, 0, 0));
 
     vdp2_tvmd_display_res_set(VDP2_TVMD_INTERLACE_NONE, VDP2_TVMD_HORZ_NORMAL_A,